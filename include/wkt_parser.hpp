@@ -4,11 +4,16 @@
 #include <string_view>
 #include <vector>
 #include <memory>
+#include <memory_resource>
 #include <optional>
 #include <variant>
 #include <stdexcept>
+#include <exception>
 #include <unordered_map>
+#include <list>
 #include <functional>
+#include <cstdint>
+#include <cstdio>
 
 namespace wkt 
 {
@@ -28,13 +33,17 @@ enum class TokenType
     EndOfInput
 };
 
+// Tokens do not own their text: `value` is a view into the lexer input
+// (the body without quotes for strings), so the input must outlive them.
+// Number tokens carry their value, converted once by the lexer.
 struct Token 
 {
     TokenType type;
-    std::string value;
+    std::string_view value;
     size_t position;
     size_t line;
     size_t column;
+    double number = 0.0;
     
     std::string typeName() const;
 };
@@ -56,6 +65,32 @@ private:
     size_t pos_, line_, col_;
 };
 
+namespace detail
+{
+    // Converts a complete number lexeme with std::from_chars (locale-independent,
+    // no exceptions); false if it is malformed or out of range.
+    bool parseDouble(std::string_view text, double& out);
+    
+    // Structural index of a block of up to 64 input bytes: one bit per byte
+    // (bit i = byte i) for each character class the lexer jumps between.
+    // Bits past the end of a short block are clear.
+    struct BlockMasks 
+    {
+        uint64_t whitespace;   // ' ', '\t', '\r', '\n'
+        uint64_t newline;      // '\n'
+        uint64_t quote;        // '"'
+        uint64_t escape;       // '\\'
+        uint64_t word;         // [A-Za-z0-9_]
+        uint64_t bracket;      // '[', ']'
+    };
+    
+    // Vectorized (AVX2 or SSE2, picked at runtime) with a scalar fallback;
+    // define WKT_NO_SIMD to force the scalar path.
+    BlockMasks classifyBlock(const char* data, size_t size);
+    BlockMasks classifyBlockScalar(const char* data, size_t size);
+    const char* simdLevel();   // "avx2", "sse2" or "scalar"
+}
+
 class Lexer 
 {
 public:
@@ -64,6 +99,25 @@ public:
     std::vector<Token> tokenize();
     Token nextToken();
     
+    // Offset of the next unread byte
+    size_t position() const { return current_; }
+    
+    // Error recovery for multi-document input: moves to the start of the
+    // line after the one containing `from` (or to the end of input)
+    void skipLine(size_t from);
+    
+    // Lazy parsing: having just read a '[', moves past its matching ']'
+    // without producing tokens (brackets inside strings do not count) and
+    // returns the offset of that ']'. Jumps between brackets and quotes
+    // using the structural index. Throws LexerError if the input ends first.
+    // With `matches`, appends the offsets of every bracket pair passed, the
+    // one just opened included, as ('[', ']') in order of the '['.
+    size_t skipSection(std::pmr::vector<std::pair<size_t, size_t>>* matches = nullptr);
+    
+    // Moves to `position`, e.g. past a ']' that skipSection recorded; the
+    // line count is not kept across the jump
+    void skipTo(size_t position) { current_ = std::min(position, input_.size()); }
+    
 private:
     void skipWhitespace();
     Token readIdentifier();
@@ -73,80 +127,601 @@ private:
     char peek() const;
     char advance();
     bool isAtEnd() const;
+    size_t column() const { return current_ - lineStart_ + 1; }
+    
+    // Masks of the 64-byte block containing `pos`, shifted so bit 0 is `pos`
+    struct Window 
+    {
+        uint64_t whitespace, newline, quote, escape, word, bracket;
+        uint64_t valid;   // bytes of the window that lie inside the input
+    };
+    Window window(size_t pos);
+    void countNewlines(uint64_t newlines, size_t from);
     
-    Token makeToken(TokenType type, std::string value = "");
+    Token makeToken(TokenType type, std::string_view value = {}, double number = 0.0);
     [[noreturn]] void error(const std::string& msg);
     
     std::string_view input_;
     size_t current_ = 0;
     size_t line_ = 1;
-    size_t column_ = 1;
+    size_t lineStart_ = 0;
     size_t tokenStart_ = 0;
+    
+    // structural index of the current block
+    detail::BlockMasks block_{};
+    size_t blockStart_ = 0;
+    size_t blockEnd_ = 0;
+};
+
+// ============================================================================
+// Names - section names
+// ============================================================================
+
+// Section names. The WKT vocabulary has fixed ids, found through a
+// compile-time perfect hash. Any other spelling gets an id hashed from its
+// text and is told apart by the text itself, so nothing is registered
+// anywhere: a node keeps its own copy of an unknown name, which goes away
+// with the node.
+using NameId = uint32_t;
+
+enum class NameMatch 
+{
+    Exact,        // same spelling
+    IgnoreCase    // ASCII case-insensitive: "Datum" matches DATUM
+};
+
+namespace names 
+{
+    // Built-in keywords (WKT1/ESRI and common WKT2); their ids never change
+    enum Keyword : NameId 
+    {
+        GEOGCS, PROJCS, GEOCCS, VERTCS, VERT_CS, COMPD_CS, LOCAL_CS, FITTED_CS,
+        DATUM, VDATUM, VERT_DATUM, LOCAL_DATUM, SPHEROID, PRIMEM, UNIT,
+        PARAMETER, PROJECTION, TOWGS84, AUTHORITY, AXIS, EXTENSION, GEOGTRAN, METHOD,
+        GEODCRS, GEOGCRS, PROJCRS, VERTCRS, COMPOUNDCRS, BASEGEOGCRS, BASEGEODCRS,
+        CONVERSION, ELLIPSOID, ANGLEUNIT, LENGTHUNIT, SCALEUNIT, CS, ORDER, ID,
+        USAGE, SCOPE, AREA, BBOX, REMARK, ANCHOR,
+        KeywordCount
+    };
+    
+    // Set in every hashed id, so none equals a keyword id
+    constexpr NameId kHashedBit = NameId(1) << 31;
+    
+    constexpr bool isKeyword(NameId id) { return id < KeywordCount; }
+    
+    // Keyword id of `name`; with IgnoreCase, of its upper-case spelling
+    std::optional<NameId> lookup(std::string_view name, NameMatch match = NameMatch::Exact);
+    
+    std::string_view text(NameId keyword);
+}
+
+// A name as nodes store it and searches compare it. `id` is the keyword id,
+// or a hash of the text with names::kHashedBit set; `folded` is the same for
+// the upper-case spelling, so names equal but for case share it. Equal
+// hashed ids are confirmed by comparing the text.
+struct SectionName 
+{
+    NameId id = 0;
+    NameId folded = 0;
+    std::string_view text;
+};
+
+namespace names 
+{
+    // `name` classified and hashed; the result views `name`
+    SectionName key(std::string_view name);
+    SectionName key(NameId keyword);
+    
+    // Splits a "DATUM/SPHEROID" path into names viewing `path` (a single
+    // trailing '/' is ignored). False on an empty segment: no node can
+    // match it then.
+    bool resolvePath(std::string_view path, std::pmr::vector<SectionName>& names);
+    
+    namespace detail { bool equalsIgnoreCase(std::string_view a, std::string_view b); }
+    
+    inline bool matches(const SectionName& a, const SectionName& b, NameMatch match) 
+    {
+        if (match == NameMatch::Exact) 
+        {
+            return a.id == b.id && (isKeyword(a.id) || a.text == b.text);
+        }
+        return a.folded == b.folded && (isKeyword(a.folded) || detail::equalsIgnoreCase(a.text, b.text));
+    }
+}
+
+// ============================================================================
+// Serialization - output sinks
+// ============================================================================
+
+enum class NumberFormat 
+{
+    Shortest,   // shortest text that reads back as the same double; whole numbers below 1e15 in full
+    Original    // numbers unchanged since parsing copy their source lexeme
+};
+
+struct SerializeOptions 
+{
+    int indent = -1;   // spaces per nesting level; negative for a single line
+    NumberFormat numbers = NumberFormat::Shortest;
+    
+    // Text the tree was parsed from, for NumberFormat::Original (numbers
+    // without a lexeme inside it fall back to Shortest). WKTDocument passes
+    // its originalSource() when this is left empty.
+    std::string_view source;
+    
+    // toString(): walk the tree once more up front to size the result
+    // exactly, so it is allocated once. Off by default, since the extra walk
+    // formats every number twice to save a few reallocations.
+    bool exactSize = false;
+};
+
+// Destination for serialized text. The serializer stages output in a small
+// fixed buffer and hands it over in large pieces, in order.
+class OutputSink 
+{
+public:
+    virtual ~OutputSink() = default;
+    virtual void write(const char* data, size_t size) = 0;
+};
+
+// Appends to a caller-owned string; reusing one string across calls keeps
+// its capacity, so steady-state serialization allocates nothing.
+class StringSink : public OutputSink 
+{
+public:
+    explicit StringSink(std::string& out) : out_(out) {}
+    void write(const char* data, size_t size) override { out_.append(data, size); }
+    
+private:
+    std::string& out_;
+};
+
+// Writes to a stdio stream; throws std::system_error on a short write
+class FileSink : public OutputSink 
+{
+public:
+    explicit FileSink(std::FILE* file) : file_(file) {}
+    void write(const char* data, size_t size) override;
+    
+private:
+    std::FILE* file_;
+};
+
+// Writes to a POSIX file descriptor, retrying partial writes; throws
+// std::system_error on failure
+class FdSink : public OutputSink 
+{
+public:
+    explicit FdSink(int fd) : fd_(fd) {}
+    void write(const char* data, size_t size) override;
+    
+private:
+    int fd_;
+};
+
+class CallbackSink : public OutputSink 
+{
+public:
+    using Callback = std::function<void(std::string_view)>;
+    
+    explicit CallbackSink(Callback callback) : callback_(std::move(callback)) {}
+    void write(const char* data, size_t size) override { callback_(std::string_view(data, size)); }
+    
+private:
+    Callback callback_;
+};
+
+// Edited document as a scatter-gather list (see WKTDocument::patch): views
+// into the original source for untouched text, and into an owned buffer
+// for re-emitted nodes. Valid while the document and its source live.
+class PatchList 
+{
+public:
+    PatchList() = default;
+    PatchList(PatchList&&) noexcept = default;
+    PatchList& operator=(PatchList&&) noexcept = default;
+    PatchList(const PatchList&) = delete;   // pieces point into generated_
+    PatchList& operator=(const PatchList&) = delete;
+    
+    const std::vector<std::string_view>& pieces() const { return pieces_; }
+    size_t size() const { return size_; }   // total bytes
+    size_t generatedSize() const { return generated_.size(); }   // bytes not copied from the source
+    
+    void writeTo(OutputSink& sink) const;
+    void writeTo(int fd) const;   // writev in IOV_MAX batches where available
+    std::string toString() const;
+    
+private:
+    friend class WKTDocument;
+    
+    std::vector<char> generated_;   // never reallocated once pieces_ point into it
+    std::vector<std::string_view> pieces_;
+    size_t size_ = 0;
 };
 
 // ============================================================================
 // AST Node
 // ============================================================================
 
+class WKTNode;
+
+namespace detail 
+{
+    class TreeBuilder;
+    struct LazySource;
+}
+
+// Nodes are allocated from a std::pmr::memory_resource; the deleter runs the
+// destructor and hands the storage back to the resource it came from.
+struct NodeDeleter 
+{
+    std::pmr::memory_resource* resource = nullptr;
+    
+    void operator()(WKTNode* node) const;
+};
+
+using NodePtr = std::unique_ptr<WKTNode, NodeDeleter>;
+
 class WKTNode 
 {
 public:
-    WKTNode(std::string name);
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
     
-    // Accessors
-    const std::string& name() const { return name_; }
-    const std::optional<std::string>& stringValue() const { return stringValue_; }
-    const std::vector<double>& numbers() const { return numbers_; }
-    const std::vector<std::unique_ptr<WKTNode>>& children() const { return children_; }
+    explicit WKTNode(std::string_view name, allocator_type alloc = {});
+    explicit WKTNode(NameId keyword, allocator_type alloc = {});
+    ~WKTNode();
     
-    // Source position tracking
-    size_t sourceStart() const { return sourceStart_; }
-    size_t sourceEnd() const { return sourceEnd_; }
+    WKTNode(const WKTNode&) = delete;
+    WKTNode& operator=(const WKTNode&) = delete;
+    
+    // Allocates the node and everything it owns from `resource`
+    static NodePtr create(std::string_view name, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    static NodePtr create(NameId keyword, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    
+    // Accessors. In a lazily parsed document (see ParseOptions) the value,
+    // numbers and children are parsed from the source on first access.
+    std::string_view name() const { return name_.text; }
+    NameId nameId() const { return name_.id; }   // keyword id, or hashed (see SectionName)
+    const SectionName& sectionName() const { return name_; }
+    const std::optional<std::pmr::string>& stringValue() const { expand(); return stringValue_; }
+    const std::pmr::vector<double>& numbers() const { expand(); return numbers_; }
+    const std::pmr::vector<NodePtr>& children() const { expand(); return children_; }
+    
+    // False while the node's content is still unparsed source text
+    bool isExpanded() const { return lazy_ == nullptr; }
+    
+    allocator_type get_allocator() const { return numbers_.get_allocator(); }
+    std::pmr::memory_resource* resource() const { return get_allocator().resource(); }
+    
+    // Source position tracking. Offsets are stored relative to the parent:
+    // children up to the last edited one count from its start, later ones
+    // from its end, so a text edit only changes the lengths along its path
+    // (see WKTDocument::applyEdit); sourceStart() adds them up, O(depth).
+    size_t sourceStart() const;
+    size_t sourceEnd() const { return sourceStart() + sourceLength_; }
+    
+    // O(1) parts of the above, for walks that track their parent's start:
+    // the start relative to the parent's (absolute while detached), and the length
+    size_t sourceOffset() const { return fromParentEnd_ ? parent_->sourceLength_ - sourceStart_ : sourceStart_; }
+    size_t sourceLength() const { return sourceLength_; }
+    
+    // Where number `index` was spelled in the source, as an offset from
+    // sourceStart() and a length; length 0 once the number has been set
+    // or if it was never parsed
+    struct Lexeme 
+    {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+    Lexeme numberLexeme(size_t index) const 
+    {
+        expand();
+        return index < lexemes_.size() ? lexemes_[index] : Lexeme{};
+    }
     
     // Mutators
-    void setStringValue(std::string value);
+    void setStringValue(std::string_view value);
     void addNumber(double value);
-    void addChild(std::unique_ptr<WKTNode> child);
-    void setSourceRange(size_t start, size_t end);
+    void addNumber(double value, Lexeme lexeme);   // parsed: remembers its spelling
+    void addChild(NodePtr child);   // children from another resource are copied into this one
+    void setSourceRange(size_t start, size_t end);   // absolute offsets
+    
+    // Deep copy allocated from `resource`; the copy counts as modified and
+    // its numbers have no source spelling
+    NodePtr clone(std::pmr::memory_resource* resource) const;
+    
+    // Edit tracking. Parsed nodes start clean; setting the value or a
+    // number, or adding a number or child, marks the node modified and
+    // each ancestor as having a modified descendant. Nodes made by create()
+    // or clone() have no source text and count as modified.
+    WKTNode* parent() { return parent_; }
+    const WKTNode* parent() const { return parent_; }
+    bool isModified() const { return (state_ & kModified) != 0; }
+    bool isClean() const { return state_ == 0; }   // the whole subtree still reads as its source range
     
-    // Navigation
-    WKTNode* findChild(std::string_view name);
-    const WKTNode* findChild(std::string_view name) const;
-    std::vector<WKTNode*> findAllChildren(std::string_view name);
+    // Structural hashes, Merkle-style: a node's hash combines its name,
+    // value, numbers and its children's hashes in order, so equal subtrees
+    // hash equal wherever they occur (names and values are hashed by their
+    // text, so hashes are stable across processes). Computed as nodes are
+    // parsed; an edit invalidates the path to the root, which is rehashed
+    // on the next call. Equal hashes do not prove equality.
+    uint64_t hash() const;        // numbers bit for bit (0.0 and -0.0 alike)
+    uint64_t shapeHash() const;   // numbers by count only: equal for trees that differ in values alone
+    
+    // Numbers rounded to the nearest multiple of `bucket` first (exact for
+    // bucket <= 0), for grouping near-identical definitions. Not cached:
+    // walks the subtree. Values closer than `bucket` usually, but not
+    // always, share a bucket: confirm candidates with utils::areEquivalent.
+    uint64_t hash(double bucket) const;
+    
+    // Navigation; names are hashed once, children compared by id first.
+    // The NameId overloads take keyword ids.
+    WKTNode* findChild(std::string_view name, NameMatch match = NameMatch::Exact);
+    const WKTNode* findChild(std::string_view name, NameMatch match = NameMatch::Exact) const;
+    WKTNode* findChild(NameId keyword, NameMatch match = NameMatch::Exact);
+    const WKTNode* findChild(NameId keyword, NameMatch match = NameMatch::Exact) const;
+    WKTNode* findChild(const SectionName& name, NameMatch match = NameMatch::Exact);
+    std::vector<WKTNode*> findAllChildren(std::string_view name, NameMatch match = NameMatch::Exact);
+    std::vector<WKTNode*> findAllChildren(const SectionName& name, NameMatch match = NameMatch::Exact);
     
     // Deep search by path: "DATUM/SPHEROID"
-    WKTNode* findByPath(std::string_view path);
-    const WKTNode* findByPath(std::string_view path) const;
+    WKTNode* findByPath(std::string_view path, NameMatch match = NameMatch::Exact);
+    const WKTNode* findByPath(std::string_view path, NameMatch match = NameMatch::Exact) const;
+    
+    // findByPath over a path already split into names
+    WKTNode* findByNames(const SectionName* names, size_t count, NameMatch match = NameMatch::Exact);
     
     // Modification
     bool setStringValue(std::string_view path, std::string_view value);
     bool setNumber(size_t index, double value);
     bool setNumber(std::string_view path, size_t index, double value);
     
-    // Serialization
+    // Serialization. serializedSize() is the exact length serialize() will
+    // write; toString() uses it to allocate once with options.exactSize.
+    void serialize(OutputSink& sink, const SerializeOptions& options = {}) const;
+    size_t serializedSize(const SerializeOptions& options = {}) const;
+    std::string toString(const SerializeOptions& options) const;
     std::string toString(int indent = -1) const;
-    
-    // Visitor pattern
+
+    // Visitor pattern: pre-order, with an explicit stack rather than
+    // recursion, so any depth is safe
     template<typename Visitor>
     void visit(Visitor&& visitor) 
     {
         visitor(*this);
-        for (auto& child : children_) 
+        std::vector<std::pair<WKTNode*, size_t>> stack{{this, 0}};   // node, next child
+        while (!stack.empty()) 
         {
-            child->visit(std::forward<Visitor>(visitor));
+            auto& [node, next] = stack.back();
+            const auto& children = node->children();
+            if (next == children.size()) 
+            {
+                stack.pop_back();
+                continue;
+            }
+            WKTNode* child = children[next++].get();
+            visitor(*child);
+            stack.emplace_back(child, 0);
         }
     }
     
 private:
-    void toStringImpl(std::ostringstream& ss, int indent, int depth) const;
+    friend struct NodeDeleter;
+    friend class detail::TreeBuilder;
+    friend class WKTDocument;
+    
+    enum : uint8_t 
+    {
+        kModified = 1,
+        kDescendantModified = 2,
+        kParametersStale = 4   // PROJCS: a PARAMETER child was renamed or added since its map was built
+    };
+    
+    WKTNode(const SectionName& name, allocator_type alloc);   // copies a hashed name's text
+    static NodePtr create(const SectionName& name, std::pmr::memory_resource* resource);
+    
+    void markModified();
+    void markParsed() { state_ = 0; }
+    void adopt(NodePtr child);
+    
+    // Position of `child` among ours, by binary search on the offsets
+    size_t childIndex(const WKTNode* child) const;
+    
+    // Makes children up to `index` count from our start and the rest from
+    // our end; costs the distance from the previous pivot
+    void pivotChildren(size_t index);
+    
+    // Lazy nodes: expand() parses the content one level deep on first use;
+    // the children it finds are jumped over, using the bracket matches
+    // recorded at load, and left unexpanded
+    void expand() const 
+    {
+        if (lazy_) 
+        {
+            const_cast<WKTNode*>(this)->materialize();
+        }
+    }
+    void materialize();
+    
+    // hashes: computeHash() assumes the children's are current
+    void computeHash() const;
+    void refreshHash() const;
+    void invalidateHash();
+    
+    SectionName name_;   // text is static for keywords, owned otherwise
+    std::optional<std::pmr::string> stringValue_;
+    std::pmr::vector<double> numbers_;
+    std::pmr::vector<Lexeme> lexemes_;   // empty, or one per number
+    std::pmr::vector<NodePtr> children_;
     
-    std::string name_;
-    std::optional<std::string> stringValue_;
+    size_t sourceStart_ = 0;   // relative to the parent's start; absolute while detached
+    size_t sourceLength_ = 0;
+    
+    WKTNode* parent_ = nullptr;
+    const detail::LazySource* lazy_ = nullptr;   // set until the content is parsed
+    
+    // a stale node has only stale ancestors
+    mutable uint64_t hash_ = 0;
+    mutable uint64_t shapeHash_ = 0;
+    mutable bool hashValid_ = false;
+    uint8_t state_ = kModified;
+    bool fromParentEnd_ = false;   // sourceStart_ counts back from the parent's end instead
+    uint32_t lazySection_ = 0;   // while lazy_ is set: our '[' in its bracket table
+};
+
+// ============================================================================
+// Flat tree - compact, index-based node storage
+// ============================================================================
+
+// Read-only view over a contiguous array
+template<typename T>
+class ArrayView 
+{
+public:
+    ArrayView() = default;
+    ArrayView(const T* data, size_t size) : data_(data), size_(size) {}
+    
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    const T* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    
+private:
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+class FlatTree;
+
+namespace detail { class FlatTreeBuilder; }
+
+// Lightweight handle to a node of a FlatTree (tree pointer + index). Mirrors
+// the query surface of WKTNode; a default-constructed handle is "not found".
+class FlatNode 
+{
+public:
+    class ChildIterator;
+    class ChildRange;
+    
+    FlatNode() = default;
+    FlatNode(const FlatTree* tree, uint32_t index) : tree_(tree), index_(index) {}
+    
+    explicit operator bool() const { return tree_ != nullptr; }
+    bool operator==(const FlatNode& other) const { return tree_ == other.tree_ && index_ == other.index_; }
+    bool operator!=(const FlatNode& other) const { return !(*this == other); }
+    uint32_t index() const { return index_; }
+    
+    // Accessors
+    std::string_view name() const;
+    std::optional<std::string_view> stringValue() const;
+    ArrayView<double> numbers() const;
+    ChildRange children() const;
+    
+    // Source position tracking
+    size_t sourceStart() const;
+    size_t sourceEnd() const;
+    
+    NameId nameId() const;
+    SectionName sectionName() const;
+    
+    // Navigation, same semantics as WKTNode
+    FlatNode findChild(std::string_view name, NameMatch match = NameMatch::Exact) const;
+    FlatNode findChild(NameId keyword, NameMatch match = NameMatch::Exact) const;
+    FlatNode findChild(const SectionName& name, NameMatch match = NameMatch::Exact) const;
+    std::vector<FlatNode> findAllChildren(std::string_view name, NameMatch match = NameMatch::Exact) const;
+    FlatNode findByPath(std::string_view path, NameMatch match = NameMatch::Exact) const;
+    FlatNode findByNames(const SectionName* names, size_t count, NameMatch match = NameMatch::Exact) const;
+    
+private:
+    
+    const FlatTree* tree_ = nullptr;
+    uint32_t index_ = 0;
+};
+
+// Structure-of-arrays tree: all nodes of a document in pre-order, one entry
+// per node in each array, plus one shared numbers array. Strings are stored
+// as offset/length spans into the tree's own copy of the source.
+class FlatTree 
+{
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+    
+    struct Span 
+    {
+        uint32_t offset = npos;
+        uint32_t length = 0;
+    };
+    
+    static FlatTree parse(std::string_view input);
+    
+    FlatNode root() const { return empty() ? FlatNode() : FlatNode(this, 0); }
+    FlatNode find(std::string_view path, NameMatch match = NameMatch::Exact) const;   // same semantics as WKTDocument::find
+    
+    size_t size() const { return nameIds_.size(); }
+    bool empty() const { return nameIds_.empty(); }
+    std::string_view source() const { return source_; }
+    
+    // Raw arrays, indexed by node; name ids as in SectionName, each name
+    // spelled at the start of the node's source range
+    const std::vector<NameId>& nameIds() const { return nameIds_; }
+    const std::vector<Span>& values() const { return values_; }
+    const std::vector<uint32_t>& firstNumbers() const { return firstNumber_; }
+    const std::vector<uint32_t>& numberCounts() const { return numberCount_; }
+    const std::vector<uint32_t>& firstChildren() const { return firstChild_; }
+    const std::vector<uint32_t>& nextSiblings() const { return nextSibling_; }
+    const std::vector<Span>& sourceRanges() const { return ranges_; }
+    const std::vector<double>& numbers() const { return numbers_; }
+    
+private:
+    friend class FlatNode;
+    friend class detail::FlatTreeBuilder;
+    
+    std::string_view text(Span span) const { return std::string_view(source_).substr(span.offset, span.length); }
+    
+    std::string source_;
+    
+    std::vector<NameId> nameIds_;
+    std::vector<NameId> foldedIds_;
+    std::vector<uint32_t> nameLengths_;
+    std::vector<Span> values_;
+    std::vector<uint32_t> firstNumber_;
+    std::vector<uint32_t> numberCount_;
+    std::vector<uint32_t> firstChild_;
+    std::vector<uint32_t> nextSibling_;
+    std::vector<Span> ranges_;
     std::vector<double> numbers_;
-    std::vector<std::unique_ptr<WKTNode>> children_;
+};
+
+class FlatNode::ChildIterator 
+{
+public:
+    ChildIterator(const FlatTree* tree, uint32_t index) : tree_(tree), index_(index) {}
+    
+    FlatNode operator*() const { return FlatNode(tree_, index_); }
+    ChildIterator& operator++() { index_ = tree_->nextSiblings()[index_]; return *this; }
+    bool operator==(const ChildIterator& other) const { return index_ == other.index_; }
+    bool operator!=(const ChildIterator& other) const { return index_ != other.index_; }
     
-    size_t sourceStart_ = 0;
-    size_t sourceEnd_ = 0;
+private:
+    const FlatTree* tree_;
+    uint32_t index_;
+};
+
+class FlatNode::ChildRange 
+{
+public:
+    ChildRange(const FlatTree* tree, uint32_t first) : tree_(tree), first_(first) {}
+    
+    ChildIterator begin() const { return ChildIterator(tree_, first_); }
+    ChildIterator end() const { return ChildIterator(tree_, FlatTree::npos); }
+    bool empty() const { return first_ == FlatTree::npos; }
+    size_t size() const;
+    
+private:
+    const FlatTree* tree_;
+    uint32_t first_;
 };
 
 // ============================================================================
@@ -157,90 +732,834 @@ class ParseError : public std::runtime_error
 {
 public:
     ParseError(const std::string& msg, const Token& token);
+    ParseError(const ParseError& other);
+    ParseError& operator=(const ParseError& other);
     
+    // The token's value refers to a copy owned by the exception, so it
+    // stays valid after the parsed input is gone.
     const Token& token() const { return token_; }
     
 private:
+    std::string lexeme_;
     Token token_;
 };
 
+
+class SectionIndex;
+
+// Two modes: over a pre-tokenized vector, or streaming, pulling tokens from a
+// Lexer on demand with one token of lookahead (no token vector is built).
 class Parser 
 {
 public:
-    explicit Parser(std::vector<Token> tokens);
+    // Nodes are allocated from `resource`
+    explicit Parser(std::vector<Token> tokens, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    explicit Parser(Lexer& lexer, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    
+    // `index`, if given, records every node as it is created
+    NodePtr parse(SectionIndex* index = nullptr);
+    
+    // Builds the flat representation instead; spans are offsets into the lexer input
+    void parseFlat(FlatTree& out);
+    
+    // Multi-document input (streaming mode): one top-level node per call,
+    // stopping after its closing bracket with the next one already looked
+    // ahead. `range` receives the node's absolute [start, end); the node's
+    // own source ranges are relative to start. A lexer error on that
+    // lookahead belongs to the next record: it is thrown by the next call.
+    bool hasNext() const { return !isAtEnd() || lookaheadError_; }
+    size_t nextPosition() const { return peek().position; }
+    NodePtr parseNext(std::pmr::memory_resource* resource, std::pair<size_t, size_t>& range,
+                      SectionIndex* index = nullptr);
+    std::pair<size_t, size_t> skipNext();   // same grammar, no tree built
+    
+    // Checks the whole input against the grammar exactly as parse() does,
+    // throwing the same errors, without building anything
+    void validate();
     
-    std::unique_ptr<WKTNode> parse();
+    // Transient state (the stack of open sections) is allocated from
+    // `scratch` instead of the node resource; nullptr restores that
+    void setScratch(std::pmr::memory_resource* scratch) { scratch_ = scratch; }
     
 private:
-    std::unique_ptr<WKTNode> parseNode();
-    void parseNodeContent(WKTNode& node);
+    template<typename Builder> void parseDocument(Builder& builder);
+    template<typename Builder> void parseNode(Builder& builder);
+    template<typename Builder> void openNode(Builder& builder);
     
     const Token& peek() const;
     const Token& previous() const;
-    Token advance();
+    const Token& advance();
     bool check(TokenType type) const;
     bool match(TokenType type);
-    Token consume(TokenType type, const std::string& message);
+    const Token& consume(TokenType type, const char* message);
+    const Token& closeTopLevel();
+    void throwLookaheadError();
     bool isAtEnd() const;
     
     [[noreturn]] void error(const std::string& msg);
     
+    Token pull();
+    
     std::vector<Token> tokens_;
-    size_t current_ = 0;
+    size_t next_ = 0;
+    Lexer* lexer_ = nullptr;
+    std::pmr::memory_resource* resource_;
+    std::pmr::memory_resource* scratch_ = nullptr;
+    
+    Token current_{};
+    Token previous_{};
+    std::exception_ptr lookaheadError_;   // lexing current_ failed; see closeTopLevel
 };
 
 // ============================================================================
 // WKT Document - High-level API
 // ============================================================================
 
+namespace detail 
+{
+    // Read-only memory mapping of a whole file
+    class MappedFile 
+    {
+    public:
+        MappedFile(void* data, size_t size) : data_(data), size_(size) {}
+        ~MappedFile();
+        
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        
+        std::string_view view() const { return std::string_view(static_cast<const char*>(data_), size_); }
+        
+    private:
+        void* data_;
+        size_t size_;
+    };
+    
+    // Regular files at least this large are mapped instead of read
+    constexpr size_t kMapThreshold = 16 * 1024;
+    
+    // Loads `path` for parsing: maps large regular files (POSIX only) and
+    // returns the mapping; otherwise reads the contents into `buffer` (tiny
+    // files, pipes, other streams) and returns null. Throws std::system_error.
+    std::unique_ptr<MappedFile> loadFile(const std::string& path, std::pmr::string& buffer);
+}
+
+// Where each section name occurs in one tree, recorded in pre-order while
+// the tree is built. first() is the node find(name) would return: a direct
+// child beats a deeper match found under an earlier sibling, otherwise the
+// earliest match wins. Keyword names are found by direct indexing.
+class SectionIndex 
+{
+public:
+    explicit SectionIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    
+    WKTNode* first(const SectionName& name) const;
+    ArrayView<WKTNode*> all(const SectionName& name) const;   // document order
+    WKTNode* first(NameId keyword) const { return first(names::key(keyword)); }
+    ArrayView<WKTNode*> all(NameId keyword) const { return all(names::key(keyword)); }
+    
+    // Building: nodes in pre-order with their depth (root = 0)
+    void clear();
+    void add(WKTNode* node, size_t depth);
+    void rebuild(WKTNode* root);
+    
+    // Incremental update after the subtree at `removed` was swapped for the
+    // one at `inserted` (already in the tree, with following offsets
+    // shifted). `removed` must still be alive with its old parent link.
+    // Touches only the groups of names occurring in either subtree, and
+    // in each only the entries of the two subtrees; if find()'s pick was
+    // removed, first() looks for the new one when next asked.
+    void replace(const WKTNode* removed, WKTNode* inserted);
+    
+private:
+    struct Group 
+    {
+        NameId name;
+        std::pmr::string text;   // hashed names only
+        WKTNode* first;
+        bool firstStale;       // `first` was removed by replace()
+        uint32_t firstIndex;   // pre-order position and depth of `first`
+        uint32_t firstDepth;
+        std::pmr::vector<WKTNode*> all;
+    };
+    
+    Group* group(const SectionName& name);
+    const Group* group(const SectionName& name) const;
+    Group& addGroup(const SectionName& name, WKTNode* node);
+    static void pickFirst(Group& group);
+    
+    std::pmr::vector<Group> groups_;
+    static constexpr uint32_t kNoGroup = UINT32_MAX;
+    uint32_t keywordGroups_[names::KeywordCount];   // kNoGroup: no such section
+    std::pmr::unordered_multimap<NameId, uint32_t> hashedGroups_;   // by id; text tells collisions apart
+    
+    // build state: pre-order positions of the current node's ancestors
+    std::pmr::vector<uint32_t> path_;
+    uint32_t count_ = 0;
+};
+
+// Projection parameters with a known meaning. Lookups by name accept the
+// ESRI and OGC/EPSG spellings of each (case, '_' and spaces ignored), e.g.
+// "Central_Meridian", "central meridian" and "Longitude_Of_Natural_Origin".
+enum class ProjectionParameter : uint8_t 
+{
+    FalseEasting,
+    FalseNorthing,
+    CentralMeridian,
+    LatitudeOfOrigin,
+    ScaleFactor,
+    StandardParallel1,
+    StandardParallel2,
+    Azimuth,
+    Unknown
+};
+
+constexpr size_t kProjectionParameterCount = size_t(ProjectionParameter::Unknown);
+
+// Known parameter for a name or alias; Unknown if it is not one
+ProjectionParameter projectionParameter(std::string_view name);
+
+struct ParameterValue 
+{
+    std::string_view name;       // as written in the PARAMETER node
+    ProjectionParameter key;
+    double value;                // NaN if the node has no number
+};
+
+// The PARAMETER children of one PROJCS node, keyed for direct lookup. It
+// refers to the nodes, so values changed through setNumber are seen; a
+// PARAMETER renamed or added since is picked up when the document next
+// hands the map out (WKTDocument::parameters / getParameter).
+class ParameterMap 
+{
+public:
+    explicit ParameterMap(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    ParameterMap(const WKTNode* projcs, std::pmr::memory_resource* resource);
+    
+    const WKTNode* owner() const { return owner_; }
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    
+    // First matching PARAMETER; name lookups are case-insensitive and
+    // resolve aliases of known parameters
+    std::optional<double> get(std::string_view name) const;
+    std::optional<double> get(ProjectionParameter key) const;
+    const WKTNode* find(std::string_view name) const;
+    const WKTNode* find(ProjectionParameter key) const;
+    
+    // Bulk: every parameter in document order; reuses out's capacity
+    void extract(std::vector<ParameterValue>& out) const;
+    
+private:
+    friend class WKTDocument;
+    
+    // applyEdit: points the entry for `removed` at `inserted`; false if the
+    // two do not spell the same parameter and the map must be rebuilt
+    bool replaceParameter(const WKTNode* removed, const WKTNode* inserted);
+    
+    struct Entry 
+    {
+        std::pmr::string normalized;   // lower-case letters and digits only
+        ProjectionParameter key;
+        const WKTNode* node;
+    };
+    
+    static constexpr uint32_t kNoEntry = UINT32_MAX;
+    
+    const WKTNode* owner_ = nullptr;
+    std::pmr::vector<Entry> entries_;
+    uint32_t byKey_[kProjectionParameterCount];   // first entry per key, kNoEntry if none
+};
+
+// Replaces [start, end) of a document's source with `text`
+struct TextEdit 
+{
+    size_t start;
+    size_t end;
+    std::string_view text;
+};
+
+// How WKTDocument::parse / parseFile build the tree
+struct ParseOptions 
+{
+    // Build only the root up front. Every other node is found by bracket
+    // matching, recording its name and source span without tokenizing its
+    // content, and is parsed one level deep the first time children(),
+    // findChild(), numbers() or stringValue() reaches it. Pays off when a
+    // few fields are read from large definitions.
+    bool lazy = false;
+    
+    // Lazy mode: by default loading only matches brackets, and an error
+    // inside a subtree is thrown when that subtree is first expanded (as the
+    // same LexerError/ParseError an eager parse reports). With this set the
+    // whole input is checked against the grammar while loading, so parse()
+    // accepts and rejects exactly what an eager parse does; the check builds
+    // nothing but tokenizes everything, so it costs most of an eager parse.
+    bool validateOnLoad = false;
+    
+    // Eager mode: the parser's transient state comes from here rather than
+    // the document arena. A pool kept across parses (BatchParser holds one
+    // per worker) makes it allocation-free once warm. Used from one thread
+    // at a time; nullptr: the document arena.
+    std::pmr::memory_resource* scratch = nullptr;
+};
+
+// A document owns a monotonic arena that backs the whole node tree and the
+// source copy; destroying the document releases the arena in one go instead
+// of freeing node by node. The arena draws its blocks from `upstream`.
 class WKTDocument 
 {
 public:
     // Parsing
-    static WKTDocument parse(std::string_view input);
-    static std::optional<WKTDocument> tryParse(std::string_view input, std::string* errorOut = nullptr);
+    static WKTDocument parse(std::string_view input,
+                             std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    static std::optional<WKTDocument> tryParse(std::string_view input, std::string* errorOut = nullptr,
+                                               std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    static WKTDocument parse(std::string_view input, const ParseOptions& options,
+                             std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    static std::optional<WKTDocument> tryParse(std::string_view input, const ParseOptions& options,
+                                               std::string* errorOut = nullptr,
+                                               std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    
+    // Parsing straight from a file: large files are mapped and lexed in
+    // place, and the mapping stays alive as originalSource(); small files
+    // are read once into the arena. I/O failures throw std::system_error
+    // (parseFile) or are reported through errorOut (tryParseFile).
+    static WKTDocument parseFile(const std::string& path,
+                                 std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    static std::optional<WKTDocument> tryParseFile(const std::string& path, std::string* errorOut = nullptr,
+                                                   std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    static WKTDocument parseFile(const std::string& path, const ParseOptions& options,
+                                 std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    static std::optional<WKTDocument> tryParseFile(const std::string& path, const ParseOptions& options,
+                                                   std::string* errorOut = nullptr,
+                                                   std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    
+    // Lazy documents: parses every node still unexpanded and builds the
+    // section index, after which the document behaves as if parsed eagerly.
+    // Expansion writes to the tree, so a lazy document must not be read
+    // from several threads before this. No-op for eager documents.
+    void expandAll();
+    
+    WKTDocument(WKTDocument&& other) noexcept = default;
+    WKTDocument& operator=(WKTDocument&& other) noexcept;
+    ~WKTDocument();
     
     // Access
     WKTNode* root() { return root_.get(); }
     const WKTNode* root() const { return root_.get(); }
-    const std::string& originalSource() const { return source_; }
+    std::string_view originalSource() const { return mapping_ ? mapping_->view() : std::string_view(source_); }
+    std::pmr::memory_resource* resource() const { return arena_.get(); }
     
     // Navigation shortcuts
-    WKTNode* find(std::string_view path);
-    const WKTNode* find(std::string_view path) const;
+    WKTNode* find(std::string_view path, NameMatch match = NameMatch::Exact);
+    const WKTNode* find(std::string_view path, NameMatch match = NameMatch::Exact) const;
     
     // Modification with automatic re-serialization
     bool setValue(std::string_view sectionName, std::string_view value);
     bool setNumber(std::string_view sectionName, size_t index, double value);
     bool setNumbers(std::string_view sectionName, const std::vector<double>& values);
     
-    // Get modified source
+    // Get modified source; pretty printing indents by 2
+    void serialize(OutputSink& sink, const SerializeOptions& options = {}) const;
+    size_t serializedSize(const SerializeOptions& options = {}) const;
+    std::string toString(const SerializeOptions& options) const;
     std::string toString(bool pretty = false) const;
     
+    // Output that keeps the source text of everything not edited: clean
+    // subtrees and the text around edited descendants are referenced from
+    // originalSource(), and only modified nodes are re-emitted (compact,
+    // numbers not set since parsing keep their spelling). An unedited
+    // document patches to its source exactly; the cost scales with the
+    // edits, not with the document.
+    PatchList patch() const;
+    
+    // Incremental reparse: applies `edit` to originalSource() and re-parses
+    // only the smallest node enclosing it, widening to its ancestors while
+    // the new text does not parse as a single node. Offsets are shifted
+    // along the path only, and the section index and parameters are
+    // patched in place. Returns the re-parsed node; replaced nodes stay in
+    // the arena until the document is destroyed.
+    // Throws LexerError/ParseError if the edited text is not valid WKT (the
+    // document is left unchanged), std::out_of_range for a range outside
+    // the source, and std::logic_error if the tree has edits made through
+    // the node API that its source does not reflect.
+    WKTNode* applyEdit(const TextEdit& edit);
+    
     // Validation
     bool isValid() const { return root_ != nullptr; }
     
-    // Common WKT queries
+    // Section index recorded at parse time (built by expandAll() for a lazy
+    // document). Edits through root() that add or remove nodes are not
+    // tracked: call reindex() after them.
+    const SectionIndex& sections() const;
+    void reindex();
+    
+    // Common WKT queries, answered from the section index; a lazy document
+    // walks to the section instead, expanding only the nodes on the way
     std::optional<std::string> getProjectionName() const;
     std::optional<std::string> getDatumName() const;
     std::optional<std::string> getSpheroidName() const;
     std::optional<std::pair<double, double>> getSpheroidParams() const;  // semi-major axis, inverse flattening
     
+    // Same without copying: views into the document, valid while it lives
+    // and the value is not changed
+    std::optional<std::string_view> getProjectionNameView() const;
+    std::optional<std::string_view> getDatumNameView() const;
+    std::optional<std::string_view> getSpheroidNameView() const;
+    
+    // PARAMETER lookup per PROJCS, built at parse time (and by reindex());
+    // a lazy document builds each map when it is first asked for
+    const ParameterMap& parameters() const;   // of the PROJCS find() returns; empty if none
+    const ParameterMap* parameters(const WKTNode* projcs) const;   // null if not one of ours
+    std::optional<double> getParameter(std::string_view name) const { return parameters().get(name); }
+    std::optional<double> getParameter(ProjectionParameter key) const { return parameters().get(key); }
+    
 private:
-    WKTDocument() = default;
+    friend class WKTStreamReader;
     
-    std::unique_ptr<WKTNode> root_;
-    std::string source_;
+    explicit WKTDocument(std::unique_ptr<std::pmr::monotonic_buffer_resource> arena);
+    
+    void parseSource(std::pmr::memory_resource* scratch = nullptr);
+    void loadLazy(bool validate);
+    void buildParameters();
+    const WKTNode* firstSection(NameId name) const;
+    SerializeOptions withSource(const SerializeOptions& options) const;
+    NodePtr parseRange(size_t start, size_t end);
+    void replaceNode(WKTNode* node, NodePtr replacement, size_t delta);
+    void updateParameters(const WKTNode* removed, const WKTNode* inserted);
+    
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+    NodePtr root_;
+    std::pmr::string source_;
+    SectionIndex index_;
+    std::pmr::list<ParameterMap> parameters_;   // lazy documents add maps on demand
+    std::unique_ptr<detail::MappedFile> mapping_;   // replaces source_ for mapped files
+    bool indexed_ = true;   // false until a lazy document is expanded: index_ is unused then
+};
+
+// ============================================================================
+// Compiled paths
+// ============================================================================
+
+// A "PROJCS/GEOGCS/DATUM" path split and hashed once, then evaluated
+// against any number of documents; keyword segments are compared by id
+// alone.
+//
+// Search::Deep gives exactly the WKTDocument::find / findByPath results:
+//  - against a document, the first segment may name the root itself;
+//  - each segment takes the FIRST child with that name and the rest of the
+//    path must resolve below it (later siblings are not tried);
+//  - when the first segment names no child of the current node, the whole
+//    remaining path is searched for under each child in turn, depth first,
+//    so "SPHEROID" finds GEOGCS/DATUM/SPHEROID. The fallback applies at
+//    every level where the path did not continue directly.
+// Search::Anchored drops that fallback: every segment must be a direct child
+// of the node matched by the previous one.
+class CompiledPath 
+{
+public:
+    enum class Search 
+    {
+        Deep,
+        Anchored
+    };
+    
+    explicit CompiledPath(std::string_view path, NameMatch match = NameMatch::Exact, Search search = Search::Deep);
+    
+    WKTNode* find(WKTDocument& doc) const;
+    const WKTNode* find(const WKTDocument& doc) const;
+    FlatNode find(const FlatTree& tree) const;
+    
+    // Relative to `node`, like WKTNode::findByPath: the first segment names
+    // a child (or, with Deep, a descendant)
+    WKTNode* findFrom(WKTNode* node) const;
+    const WKTNode* findFrom(const WKTNode* node) const;
+    
+    // copies re-split their own path: the names view it
+    CompiledPath(const CompiledPath& other);
+    CompiledPath& operator=(const CompiledPath& other);
+    
+    const std::string& path() const { return path_; }
+    const std::pmr::vector<SectionName>& names() const { return names_; }
+    NameMatch match() const { return match_; }
+    Search search() const { return search_; }
+    
+private:
+    void compile();
+    
+    std::string path_;
+    std::pmr::vector<SectionName> names_;   // viewing path_
+    NameMatch match_;
+    Search search_;
+    bool matchesNothing_ = false;   // an empty segment ("A//B")
 };
 
+// ============================================================================
+// Stream reading - many documents in one buffer
+// ============================================================================
+
+// One document of a multi-document stream
+struct StreamRecord 
+{
+    size_t offset = 0;        // byte offset of the record in the stream
+    std::string_view text;    // the record; for failures, up to where reading resumed
+    std::optional<WKTDocument> document;   // set by next() on success
+    std::string error;        // tryParse-style message, empty on success
+    size_t errorOffset = 0;   // byte offset the error was reported at
+    
+    bool ok() const { return error.empty(); }
+};
+
+// A piece of a stream that starts at a record boundary
+struct StreamChunk 
+{
+    std::string_view text;
+    size_t offset = 0;        // of text within the whole stream
+};
+
+// Reads successive documents from one buffer holding concatenated or
+// newline-delimited WKT. A single lexer runs across record boundaries, so
+// nothing is split or copied up front; each document gets its own arena
+// holding just its record. A malformed record is reported with its byte
+// offsets and reading resumes on the next line.
+class WKTStreamReader 
+{
+public:
+    // `input` must outlive the reader and the records' text views
+    explicit WKTStreamReader(std::string_view input,
+                             std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    
+    // Reads one chunk of a larger stream; offsets are reported stream-wide.
+    // `scratch` holds transient parser state, as ParseOptions::scratch.
+    explicit WKTStreamReader(const StreamChunk& chunk,
+                             std::pmr::memory_resource* upstream = std::pmr::get_default_resource(),
+                             std::pmr::memory_resource* scratch = nullptr);
+    
+    // Maps (or reads) the whole file and streams from it; see source()
+    static WKTStreamReader openFile(const std::string& path,
+                                    std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    
+    WKTStreamReader(WKTStreamReader&& other) noexcept;
+    WKTStreamReader& operator=(WKTStreamReader&& other) noexcept;
+    ~WKTStreamReader();
+    
+    // Next record with its document; false once the input is exhausted
+    bool next(StreamRecord& record);
+    
+    // Next record's span only: checked against the grammar, no tree built
+    bool nextSpan(StreamRecord& record);
+    
+    std::string_view source() const;
+    
+    // Splits `input` into at most `count` chunks of similar size, cutting
+    // only where a line break outside quoted strings separates a closing
+    // ']' from the next section name. Quotes are counted from the previous
+    // cut, so well-formed records are never split and each chunk can be
+    // read independently (and in parallel).
+    static std::vector<StreamChunk> split(std::string_view input, size_t count);
+    
+private:
+    struct State;
+    
+    bool read(StreamRecord& record, bool buildDocument);
+    
+    std::unique_ptr<State> state_;
+};
+
+// ============================================================================
+// Batch parsing
+// ============================================================================
+
+struct BatchResult 
+{
+    std::optional<WKTDocument> document;
+    std::string error;   // tryParse-style message when document is empty
+    
+    bool ok() const { return document.has_value(); }
+};
+
+namespace detail { class WorkStealingPool; }
+
+// Parses many inputs across a fixed set of worker threads. Items are split
+// into per-worker ranges; a worker that runs dry steals half of the largest
+// remaining range from another, so uneven inputs still keep every core busy.
+// Files go through WKTDocument::tryParseFile (mapped or read straight into
+// the document arena). Each worker keeps a scratch pool for the parser's
+// transient state across items and batches. One batch runs at a time per
+// BatchParser; concurrent calls are queued.
+class BatchParser 
+{
+public:
+    // Invoked on worker threads as items complete, possibly concurrently
+    using Callback = std::function<void(size_t index, BatchResult&& result)>;
+    
+    // threads == 0: one worker per hardware thread
+    explicit BatchParser(size_t threads = 0,
+                         std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    ~BatchParser();
+    
+    BatchParser(const BatchParser&) = delete;
+    BatchParser& operator=(const BatchParser&) = delete;
+    
+    size_t threadCount() const;
+    
+    // Results in input order
+    std::vector<BatchResult> parseBuffers(const std::vector<std::string_view>& buffers);
+    std::vector<BatchResult> parseFiles(const std::vector<std::string>& paths);
+    
+    // Results streamed to `onResult` in completion order; exceptions thrown by
+    // the callback stop the batch and are rethrown to the caller
+    void parseBuffers(const std::vector<std::string_view>& buffers, const Callback& onResult);
+    void parseFiles(const std::vector<std::string>& paths, const Callback& onResult);
+    
+    // Multi-document stream split at record boundaries and read chunk by
+    // chunk across the workers; records arrive in completion order
+    using RecordCallback = std::function<void(StreamRecord&& record)>;
+    void parseStream(std::string_view input, const RecordCallback& onRecord);
+    
+private:
+    std::unique_ptr<detail::WorkStealingPool> pool_;
+    std::pmr::memory_resource* upstream_;
+    std::vector<std::unique_ptr<std::pmr::unsynchronized_pool_resource>> scratch_;   // per worker
+};
+
+// ============================================================================
+// Parse cache
+// ============================================================================
+
+namespace detail 
+{
+    class CacheShard;
+    
+    // Content hash of a byte string; the one structural hashes use for text
+    uint64_t hashBytes(std::string_view text);
+}
+
+struct ParseCacheOptions 
+{
+    size_t maxEntries = 1024;   // 0: no limit
+    size_t maxBytes = 0;        // source bytes held (trees take several times that); 0: no limit
+    size_t shards = 16;         // rounded down to a power of two, and to at most maxEntries
+};
+
+struct ParseCacheStats 
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;        // including inputs that failed to parse
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Documents keyed by the content of their input, so byte-identical inputs
+// are parsed once and share one document. Documents are parsed eagerly and
+// handed out const: any number of threads can read one at the same time.
+//
+// Entries are spread over shards by hash, each behind its own reader-writer
+// lock. A hit takes only the shard's shared lock and sets the entry's
+// "referenced" bit; eviction runs the CLOCK approximation of LRU (entries
+// not referenced since the hand last passed go first) under the exclusive
+// lock. Limits are split across shards, the shares adding up to maxEntries
+// and maxBytes exactly. Each shard evicts at its own share, so inputs that
+// crowd one shard are evicted before the whole cache is full. A document
+// over its shard's byte budget is returned without being cached. Inputs
+// that fail to parse are not cached. Two threads missing on the same input
+// at once may both parse it; the first to insert wins and both get its
+// document.
+class ParseCache 
+{
+public:
+    // Documents allocate from `upstream`, which must outlive all of them
+    explicit ParseCache(const ParseCacheOptions& options = {},
+                        std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+    ~ParseCache();
+    
+    ParseCache(const ParseCache&) = delete;
+    ParseCache& operator=(const ParseCache&) = delete;
+    
+    // Same contracts as WKTDocument::parse / tryParse, with a pointer in
+    // place of the value: a tryParse caller using `if (!doc)`, `*doc` and
+    // `doc->` works unchanged. Thread-safe.
+    std::shared_ptr<const WKTDocument> parse(std::string_view input);
+    std::shared_ptr<const WKTDocument> tryParse(std::string_view input, std::string* errorOut = nullptr);
+    
+    // Counters are summed over the shards one at a time, so under
+    // concurrent use they are not a single consistent snapshot
+    ParseCacheStats stats() const;
+    void clear();
+    
+private:
+    using DocumentPtr = std::shared_ptr<const WKTDocument>;
+    
+    detail::CacheShard& shardFor(uint64_t hash) const;
+    DocumentPtr insert(uint64_t hash, WKTDocument&& document);
+    
+    std::unique_ptr<detail::CacheShard[]> shards_;
+    size_t shardCount_;
+    std::pmr::memory_resource* upstream_;
+};
+
+// ============================================================================
+// EPSG matching
+// ============================================================================
+
+// How far a parameter may be from a table value and still match
+struct EpsgTolerance 
+{
+    double length = 1.0;               // metres: false easting/northing, semi-major axis
+    double angle = 1e-5;               // degrees: central meridian, latitudes, azimuth
+    double scale = 1e-6;               // scale factor
+    double inverseFlattening = 1e-5;   // e.g. 298.257224 for WGS 84's 298.257223563
+};
+
+struct EpsgMatch 
+{
+    int code = 0;
+    
+    // Root mean square of the compared differences, each divided by its
+    // tolerance: 0 for identical values, at most 1 for a match
+    double distance = 0;
+    
+    // 1 only for an exact signature match. Lowered by the distance, by a
+    // datum recognized by its spheroid rather than its name, by PARAMETERs
+    // that were left out of the comparison, and split between candidates
+    // the distance cannot tell apart.
+    double confidence = 0;
+};
+
+// ============================================================================
+// Instrumentation
+// ============================================================================
+
+// Per-phase counters and timers, compiled in when the library is built with
+// WKT_INSTRUMENT defined (CMake: -DWKT_INSTRUMENT=ON). Without it the hooks
+// are empty inline functions, snapshot() returns zeros and reset() does
+// nothing. Counts are kept per thread and summed by snapshot().
+namespace instrument 
+{
+#if defined(WKT_INSTRUMENT)
+    constexpr bool kEnabled = true;
+#else
+    constexpr bool kEnabled = false;
+#endif
+    
+    enum class Phase : uint8_t 
+    {
+        Lex,         // Lexer::tokenize
+        Parse,       // Parser::parse: tokens to tree
+        Serialize,   // WKTNode::toString / serialize
+        Document,    // WKTDocument::parse / parseFile, tryParse included
+        Count
+    };
+    
+    const char* phaseName(Phase phase);
+    
+    // Totals over the calls of one phase. Nested phases count in each:
+    // the Parse inside a Document parse adds to both.
+    struct PhaseStats 
+    {
+        uint64_t calls = 0;
+        uint64_t nanoseconds = 0;   // wall time
+        uint64_t bytes = 0;         // input consumed; output written for Serialize
+        uint64_t tokens = 0;        // produced by the lexer
+        uint64_t numbers = 0;       // number lexemes converted
+        uint64_t nodes = 0;         // tree nodes built
+        uint64_t allocations = 0;   // blocks document arenas drew from their upstream
+        uint64_t exceptions = 0;    // calls left by an exception
+    };
+    
+    struct Snapshot 
+    {
+        PhaseStats phases[size_t(Phase::Count)];
+        
+        const PhaseStats& operator[](Phase phase) const { return phases[size_t(phase)]; }
+    };
+    
+    // All threads, since the last reset(). reset() only moves the baseline,
+    // so it is safe while other threads are being measured.
+    Snapshot snapshot();
+    void reset();
+}
+
+namespace detail 
+{
+    // Document arena; when instrumenting, its upstream blocks are counted
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> makeArena(std::pmr::memory_resource* upstream,
+                                                                   size_t initialSize = 0);
+    
+#if defined(WKT_INSTRUMENT)
+    // Events on this thread so far; a phase records how they changed over
+    // each call
+    struct EventCounts 
+    {
+        uint64_t tokens = 0;
+        uint64_t numbers = 0;
+        uint64_t nodes = 0;
+        uint64_t allocations = 0;
+    };
+    
+    inline thread_local EventCounts events;
+    
+    inline void countToken() { ++events.tokens; }
+    inline void countNumber() { ++events.numbers; }
+    inline void countNode() { ++events.nodes; }
+    
+    class PhaseScope 
+    {
+    public:
+        PhaseScope(instrument::Phase phase, uint64_t bytes);
+        ~PhaseScope();
+        
+        PhaseScope(const PhaseScope&) = delete;
+        PhaseScope& operator=(const PhaseScope&) = delete;
+        
+        void addBytes(uint64_t bytes) { bytes_ += bytes; }
+        
+    private:
+        instrument::Phase phase_;
+        uint64_t bytes_;
+        uint64_t start_;
+        EventCounts events_;
+        int exceptions_;
+    };
+#else
+    inline void countToken() {}
+    inline void countNumber() {}
+    inline void countNode() {}
+    
+    class PhaseScope 
+    {
+    public:
+        PhaseScope(instrument::Phase, uint64_t) {}
+        void addBytes(uint64_t) {}
+    };
+#endif
+}
+
 // ============================================================================
 // Utility functions
 // ============================================================================
 
 namespace utils 
 {
-    // EPSG code lookup (basic)
-    std::optional<int> guessEPSG(const WKTDocument& doc);
+    // EPSG code of a GEOGCS or PROJCS document, found by hashing its
+    // canonical signature into a built-in table: datum by name (a SPHEROID,
+    // if given, must be the datum's), projection method, parameters in
+    // metres and degrees with defaults filled in, and linear unit. The table
+    // covers common geographic CRSs and their UTM and Gauss-Kruger zones.
+    // An exact match also needs every PARAMETER to be part of the signature.
+    // When that finds nothing, the best matchEPSG candidate is returned
+    // instead; `confidence`, if given, is set to 1 for an exact match and
+    // to the candidate's confidence otherwise.
+    std::optional<int> guessEPSG(const WKTDocument& doc, double* confidence = nullptr);
+    
+    // Ranked candidates within `tolerance`, nearest first. The table is
+    // bucketed by datum, projection method and unit; the datum is the named
+    // one, or every datum whose spheroid fits when the name is unknown.
+    // Within a bucket, candidates are range-searched by central meridian,
+    // and then every parameter is compared.
+    std::vector<EpsgMatch> matchEPSG(const WKTDocument& doc, const EpsgTolerance& tolerance = {},
+                                     size_t maxResults = 5);
     
     // Validation
     bool validateWKT(std::string_view input, std::string* errorOut = nullptr);
@@ -1,6 +1,4 @@
 #include "wkt_parser.hpp"
-#include <sstream>
-#include <iomanip>
 #include <algorithm>
 
 namespace wkt 
@@ -10,48 +8,264 @@ namespace wkt
 // WKTNode
 // ============================================================================
 
-WKTNode::WKTNode(std::string name)
-    : name_(std::move(name))
+void NodeDeleter::operator()(WKTNode* node) const 
+{
+    // Destroys the subtree leaves first, descending through the last child
+    // and climbing back up by parent pointers: no recursion and no memory
+    // needed, however deep the tree. A node's children share its resource.
+    WKTNode* const top = node;
+    while (node) 
+    {
+        if (!node->children_.empty()) 
+        {
+            WKTNode* child = node->children_.back().release();
+            node->children_.pop_back();
+            child->parent_ = node;
+            node = child;
+            continue;
+        }
+        
+        WKTNode* parent = node == top ? nullptr : node->parent_;
+        std::pmr::memory_resource* owner = node == top ? resource : node->resource();
+        node->~WKTNode();
+        owner->deallocate(node, sizeof(WKTNode), alignof(WKTNode));
+        node = parent;
+    }
+}
+
+WKTNode::WKTNode(std::string_view name, allocator_type alloc)
+    : WKTNode(names::key(name), alloc)
 {}
 
-void WKTNode::setStringValue(std::string value)
+WKTNode::WKTNode(NameId keyword, allocator_type alloc)
+    : WKTNode(names::key(keyword), alloc)
+{}
+
+WKTNode::WKTNode(const SectionName& name, allocator_type alloc)
+    : name_(name)
+    , numbers_(alloc)
+    , lexemes_(alloc)
+    , children_(alloc)
+{
+    // keyword text is static; any other name is kept with the node
+    if (!names::isKeyword(name.id) && !name.text.empty()) 
+    {
+        char* text = static_cast<char*>(resource()->allocate(name.text.size(), 1));
+        std::copy(name.text.begin(), name.text.end(), text);
+        name_.text = std::string_view(text, name.text.size());
+    }
+}
+
+WKTNode::~WKTNode() 
+{
+    if (!names::isKeyword(name_.id) && !name_.text.empty()) 
+    {
+        resource()->deallocate(const_cast<char*>(name_.text.data()), name_.text.size(), 1);
+    }
+}
+
+NodePtr WKTNode::create(std::string_view name, std::pmr::memory_resource* resource) 
+{
+    return create(names::key(name), resource);
+}
+
+NodePtr WKTNode::create(NameId keyword, std::pmr::memory_resource* resource) 
+{
+    return create(names::key(keyword), resource);
+}
+
+NodePtr WKTNode::create(const SectionName& name, std::pmr::memory_resource* resource) 
 {
-    stringValue_ = std::move(value);
+    void* storage = resource->allocate(sizeof(WKTNode), alignof(WKTNode));
+    try 
+    {
+        return NodePtr(new (storage) WKTNode(name, allocator_type(resource)), NodeDeleter{resource});
+    }
+    catch (...) 
+    {
+        resource->deallocate(storage, sizeof(WKTNode), alignof(WKTNode));
+        throw;
+    }
+}
+
+NodePtr WKTNode::clone(std::pmr::memory_resource* resource) const 
+{
+    // A copy of one node; offsets stay relative to the parent's. Lexemes
+    // point into the original's source, which the copy may never see.
+    auto copyNode = [resource](const WKTNode& from) 
+    {
+        from.expand();
+        NodePtr copy = create(from.name_, resource);
+        if (from.stringValue_) 
+        {
+            copy->stringValue_.emplace(*from.stringValue_, copy->get_allocator());
+        }
+        copy->numbers_.assign(from.numbers_.begin(), from.numbers_.end());
+        copy->sourceStart_ = from.sourceOffset();
+        copy->sourceLength_ = from.sourceLength_;
+        copy->children_.reserve(from.children_.size());
+        
+        // same content, same hashes
+        copy->hash_ = from.hash_;
+        copy->shapeHash_ = from.shapeHash_;
+        copy->hashValid_ = from.hashValid_;
+        return copy;
+    };
+    
+    NodePtr root = copyNode(*this);
+    root->sourceStart_ = sourceStart();   // detached: absolute
+    
+    // top-down with an explicit stack; each copy is attached to its parent's
+    // before its own children are copied
+    std::vector<std::pair<const WKTNode*, WKTNode*>> pending{{this, root.get()}};
+    while (!pending.empty()) 
+    {
+        auto [from, to] = pending.back();
+        pending.pop_back();
+        for (const auto& child : from->children_) 
+        {
+            NodePtr copy = copyNode(*child);
+            copy->parent_ = to;
+            pending.emplace_back(child.get(), copy.get());
+            to->children_.push_back(std::move(copy));
+        }
+    }
+    return root;
+}
+
+void WKTNode::markModified() 
+{
+    state_ |= kModified;
+    
+    // an ancestor already flagged has all of its own ancestors flagged too
+    for (WKTNode* node = parent_; node && !(node->state_ & kDescendantModified); node = node->parent_) 
+    {
+        node->state_ |= kDescendantModified;
+    }
+    invalidateHash();
+}
+
+void WKTNode::setStringValue(std::string_view value)
+{
+    expand();
+    stringValue_.emplace(value, get_allocator());
+    markModified();
+    if (name_.id == names::PARAMETER && parent_) 
+    {
+        parent_->state_ |= kParametersStale;
+    }
 }
 
 void WKTNode::addNumber(double value) 
 {
+    expand();
+    markModified();
+    numbers_.push_back(value);
+    if (!lexemes_.empty()) 
+    {
+        lexemes_.emplace_back();
+    }
+}
+
+void WKTNode::addNumber(double value, Lexeme lexeme) 
+{
+    // numbers added without a spelling so far get empty lexemes
+    expand();
+    markModified();
+    lexemes_.resize(numbers_.size());
     numbers_.push_back(value);
+    lexemes_.push_back(lexeme);
 }
 
-void WKTNode::addChild(std::unique_ptr<WKTNode> child) 
+void WKTNode::addChild(NodePtr child) 
 {
+    expand();
+    
+    // keep the whole tree inside one resource so an arena can drop it wholesale
+    if (child.get_deleter().resource != resource()) 
+    {
+        child = child->clone(resource());
+    }
+    if (child->nameId() == names::PARAMETER) 
+    {
+        state_ |= kParametersStale;
+    }
+    adopt(std::move(child));
+    markModified();
+}
+
+void WKTNode::adopt(NodePtr child) 
+{
+    // offsets become relative to ours; unsigned wrap-around keeps the sum
+    // exact even for a child placed before us
+    child->sourceStart_ -= sourceStart();
+    
+    // after the pivot, children count from our end
+    if (!children_.empty() && children_.back()->fromParentEnd_) 
+    {
+        child->sourceStart_ = sourceLength_ - child->sourceStart_;
+        child->fromParentEnd_ = true;
+    }
+    child->parent_ = this;
     children_.push_back(std::move(child));
 }
 
-void WKTNode::setSourceRange(size_t start, size_t end) 
+size_t WKTNode::childIndex(const WKTNode* child) const 
 {
-    sourceStart_ = start;
-    sourceEnd_ = end;
+    const size_t offset = child->sourceOffset();
+    auto it = std::lower_bound(children_.begin(), children_.end(), offset,
+                               [](const NodePtr& c, size_t value) { return c->sourceOffset() < value; });
+    while (it->get() != child)   // only zero-length siblings share an offset
+    {
+        ++it;
+    }
+    return size_t(it - children_.begin());
 }
 
-WKTNode* WKTNode::findChild(std::string_view name) 
+void WKTNode::pivotChildren(size_t index) 
 {
-    for (const auto& child : children_) 
+    // the children counting from our end are always a suffix
+    for (size_t i = index + 1; i < children_.size() && !children_[i]->fromParentEnd_; ++i) 
     {
-        if (child->name() == name) 
-        {
-            return child.get();
-        }
+        children_[i]->sourceStart_ = sourceLength_ - children_[i]->sourceStart_;
+        children_[i]->fromParentEnd_ = true;
+    }
+    for (size_t i = index + 1; i-- > 0 && children_[i]->fromParentEnd_;) 
+    {
+        children_[i]->sourceStart_ = sourceLength_ - children_[i]->sourceStart_;
+        children_[i]->fromParentEnd_ = false;
     }
-    return nullptr;
 }
 
-const WKTNode* WKTNode::findChild(std::string_view name) const 
+size_t WKTNode::sourceStart() const 
 {
+    size_t start = sourceOffset();
+    for (const WKTNode* node = parent_; node; node = node->parent_) 
+    {
+        start += node->sourceOffset();
+    }
+    return start;
+}
+
+void WKTNode::setSourceRange(size_t start, size_t end) 
+{
+    // children counting from our end stay put as our length changes
+    if (!children_.empty() && children_.back()->fromParentEnd_) 
+    {
+        pivotChildren(children_.size() - 1);
+    }
+    
+    const size_t offset = parent_ ? start - parent_->sourceStart() : start;
+    sourceStart_ = fromParentEnd_ ? parent_->sourceLength_ - offset : offset;
+    sourceLength_ = end - start;
+}
+
+WKTNode* WKTNode::findChild(const SectionName& name, NameMatch match) 
+{
+    expand();
     for (const auto& child : children_) 
     {
-        if (child->name() == name) 
+        if (names::matches(child->name_, name, match)) 
         {
             return child.get();
         }
@@ -59,12 +273,33 @@ const WKTNode* WKTNode::findChild(std::string_view name) const
     return nullptr;
 }
 
-std::vector<WKTNode*> WKTNode::findAllChildren(std::string_view name) 
+WKTNode* WKTNode::findChild(NameId keyword, NameMatch match) 
+{
+    return findChild(names::key(keyword), match);
+}
+
+const WKTNode* WKTNode::findChild(NameId keyword, NameMatch match) const 
+{
+    return const_cast<WKTNode*>(this)->findChild(keyword, match);
+}
+
+WKTNode* WKTNode::findChild(std::string_view name, NameMatch match) 
+{
+    return findChild(names::key(name), match);
+}
+
+const WKTNode* WKTNode::findChild(std::string_view name, NameMatch match) const 
 {
+    return const_cast<WKTNode*>(this)->findChild(name, match);
+}
+
+std::vector<WKTNode*> WKTNode::findAllChildren(const SectionName& name, NameMatch match) 
+{
+    expand();
     std::vector<WKTNode*> result;
     for (const auto& child : children_) 
     {
-        if (child->name() == name) 
+        if (names::matches(child->name_, name, match)) 
         {
             result.push_back(child.get());
         }
@@ -72,43 +307,81 @@ std::vector<WKTNode*> WKTNode::findAllChildren(std::string_view name)
     return result;
 }
 
-WKTNode* WKTNode::findByPath(std::string_view path) 
+std::vector<WKTNode*> WKTNode::findAllChildren(std::string_view name, NameMatch match) 
+{
+    return findAllChildren(names::key(name), match);
+}
+
+WKTNode* WKTNode::findByPath(std::string_view path, NameMatch match) 
 {
-    if (path.empty()) 
+    std::byte buffer[16 * sizeof(SectionName)];
+    std::pmr::monotonic_buffer_resource local(buffer, sizeof(buffer));
+    std::pmr::vector<SectionName> names(&local);
+    
+    if (!names::resolvePath(path, names)) 
     {
-        return this;
+        return nullptr;
     }
-    
-    const size_t slashPos = path.find('/');
-    const std::string_view first = (slashPos == std::string_view::npos)  ? path  : path.substr(0, slashPos);
-    const std::string_view rest = (slashPos == std::string_view::npos) ? std::string_view{} : path.substr(slashPos + 1);
+    return findByNames(names.data(), names.size(), match);
+}
 
-    for (auto& child : children_) 
+const WKTNode* WKTNode::findByPath(std::string_view path, NameMatch match) const 
+{
+    return const_cast<WKTNode*>(this)->findByPath(path, match);
+}
+
+WKTNode* WKTNode::findByNames(const SectionName* names, size_t count, NameMatch match) 
+{
+    // Nodes whose children are being searched for the rest of the path, in
+    // the order the recursive search would try them. Each node is searched
+    // at most once, so the walk is linear in the tree size.
+    struct Frame 
+    {
+        WKTNode* node;
+        size_t next;      // child to search next
+        size_t segment;   // first name still to match
+    };
+    std::byte buffer[16 * sizeof(Frame)];
+    std::pmr::monotonic_buffer_resource local(buffer, sizeof(buffer));
+    std::pmr::vector<Frame> stack(&local);
+    
+    WKTNode* node = this;
+    size_t segment = 0;
+    for (;;) 
     {
-        if (child->name() == first) 
+        if (node) 
         {
-            if (rest.empty()) 
+            if (segment == count) 
+            {
+                return node;
+            }
+            
+            // the first child matching the next segment commits the search to it
+            if (WKTNode* child = node->findChild(names[segment], match)) 
             {
-                return child.get();
+                node = child;
+                ++segment;
+                continue;
             }
-            return child->findByPath(rest);
+            
+            // otherwise look for the rest of the path under each child in turn
+            stack.push_back({node, 0, segment});
         }
-    }
-    
-    for (auto& child : children_) 
-    {
-        if (WKTNode* found = child->findByPath(path)) 
+        
+        if (stack.empty()) 
+        {
+            return nullptr;
+        }
+        Frame& frame = stack.back();
+        if (frame.next == frame.node->children_.size()) 
         {
-            return found;
+            stack.pop_back();
+            node = nullptr;
+            continue;
         }
+        node = frame.node->children_[frame.next++].get();
+        segment = frame.segment;
     }
-    
-    return nullptr;
-}
-
-const WKTNode* WKTNode::findByPath(std::string_view path) const 
-{
-    return const_cast<WKTNode*>(this)->findByPath(path);
 }
 
 bool WKTNode::setStringValue(std::string_view path, std::string_view value) 
@@ -118,17 +391,23 @@ bool WKTNode::setStringValue(std::string_view path, std::string_view value)
     {
         return false;
     }
-    node->stringValue_ = std::string(value);
+    node->setStringValue(value);
     return true;
 }
 
 bool WKTNode::setNumber(size_t index, double value) 
 {
+    expand();
     if (index >= numbers_.size()) 
     {
         return false;
     }
     numbers_[index] = value;
+    markModified();
+    if (index < lexemes_.size()) 
+    {
+        lexemes_[index] = Lexeme{};
+    }
     return true;
 }
 
@@ -142,64 +421,4 @@ bool WKTNode::setNumber(std::string_view path, size_t index, double value)
     return node->setNumber(index, value);
 }
 
-std::string WKTNode::toString(int indent) const 
-{
-    std::ostringstream ss;
-    toStringImpl(ss, indent, 0);
-    return ss.str();
-}
-
-void WKTNode::toStringImpl(std::ostringstream& ss, int indent, int depth) const 
-{
-    bool pretty = (indent >= 0);
-    const std::string indentStr = pretty ? std::string(depth * indent, ' ') : "";
-    const std::string childIndent = pretty ? std::string((depth + 1) * indent, ' ') : "";
-    const std::string newline = pretty ? "\n" : "";
-    
-    ss << name_ << "[";
-    
-    bool needComma = false;
-    if (stringValue_) 
-    {
-        ss << "\"" << *stringValue_ << "\"";
-        needComma = true;
-    }
-
-    for (double num : numbers_) 
-    {
-        if (needComma) ss << ",";
-        if (num == static_cast<int64_t>(num)) 
-        {
-            ss << static_cast<int64_t>(num);
-        } 
-        else 
-        {
-            ss << std::setprecision(15) << num;
-        }
-        needComma = true;
-    }
-    
-    for (const auto& child : children_) 
-    {
-        if (needComma) 
-        {
-            ss << ",";
-        }
-
-        if (pretty) 
-        {
-            ss << newline << childIndent;
-        }
-        child->toStringImpl(ss, indent, depth + 1);
-        needComma = true;
-    }
-    
-    if (pretty && !children_.empty()) 
-    {
-        ss << newline << indentStr;
-    }
-    
-    ss << "]";
-}
-
 } // namespace wkt
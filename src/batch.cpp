@@ -0,0 +1,353 @@
+#include "wkt_parser.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace wkt
+{
+
+namespace detail
+{
+
+// ============================================================================
+// WorkStealingPool
+// ============================================================================
+
+// Runs `task(index, worker)` for every index of a job. Each worker owns a
+// [begin, end) range packed into one atomic word: the owner takes items from
+// the front, thieves split off the back half, both with a single CAS.
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void(size_t index, size_t worker)>;
+
+    explicit WorkStealingPool(size_t threads);
+    ~WorkStealingPool();
+
+    size_t size() const { return threads_.size(); }
+
+    // Blocks until every index in [0, count) has been processed
+    void run(size_t count, const Task& task);
+
+private:
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> range{0};
+    };
+
+    static uint64_t pack(uint32_t begin, uint32_t end) { return (uint64_t(end) << 32) | begin; }
+    static uint32_t beginOf(uint64_t range) { return uint32_t(range); }
+    static uint32_t endOf(uint64_t range) { return uint32_t(range >> 32); }
+
+    void workerLoop(size_t id);
+    void drain(size_t id);
+    bool popLocal(size_t id, size_t& index);
+    bool steal(size_t thief);
+
+    std::vector<std::thread> threads_;
+    std::unique_ptr<Slot[]> slots_;
+
+    std::mutex runMutex_;   // one job at a time
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const Task* task_ = nullptr;
+    uint64_t generation_ = 0;
+    size_t active_ = 0;
+    bool stop_ = false;
+
+    std::atomic<bool> cancelled_{false};
+    std::exception_ptr error_;
+};
+
+WorkStealingPool::WorkStealingPool(size_t threads)
+    : slots_(new Slot[threads ? threads : 1])
+{
+    if (threads == 0)
+    {
+        threads = 1;
+    }
+
+    threads_.reserve(threads);
+    for (size_t id = 0; id < threads; ++id)
+    {
+        threads_.emplace_back([this, id] { workerLoop(id); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+
+    for (auto& thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::run(size_t count, const Task& task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (count >= UINT32_MAX)
+    {
+        throw std::length_error("BatchParser: too many items in one batch");
+    }
+
+    std::lock_guard<std::mutex> runLock(runMutex_);
+
+    // contiguous initial shares keep neighbouring items on one worker
+    const size_t workers = threads_.size();
+    for (size_t id = 0; id < workers; ++id)
+    {
+        const uint32_t begin = uint32_t(count * id / workers);
+        const uint32_t end = uint32_t(count * (id + 1) / workers);
+        slots_[id].range.store(pack(begin, end), std::memory_order_relaxed);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_ = &task;
+    error_ = nullptr;
+    cancelled_.store(false, std::memory_order_relaxed);
+    active_ = workers;
+    generation_++;
+    wake_.notify_all();
+
+    done_.wait(lock, [this] { return active_ == 0; });
+    task_ = nullptr;
+
+    if (error_)
+    {
+        std::rethrow_exception(error_);
+    }
+}
+
+void WorkStealingPool::workerLoop(size_t id)
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+            {
+                return;
+            }
+            seen = generation_;
+        }
+
+        drain(id);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--active_ == 0)
+        {
+            done_.notify_one();
+        }
+    }
+}
+
+void WorkStealingPool::drain(size_t id)
+{
+    size_t index = 0;
+    while (!cancelled_.load(std::memory_order_relaxed))
+    {
+        if (!popLocal(id, index))
+        {
+            // ranges only ever shrink, so finding nothing to steal means done
+            if (!steal(id))
+            {
+                return;
+            }
+            continue;
+        }
+
+        try
+        {
+            (*task_)(index, id);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_)
+            {
+                error_ = std::current_exception();
+            }
+            cancelled_.store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool WorkStealingPool::popLocal(size_t id, size_t& index)
+{
+    std::atomic<uint64_t>& slot = slots_[id].range;
+    uint64_t range = slot.load(std::memory_order_acquire);
+
+    while (beginOf(range) < endOf(range))
+    {
+        if (slot.compare_exchange_weak(range, pack(beginOf(range) + 1, endOf(range)), std::memory_order_acq_rel))
+        {
+            index = beginOf(range);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkStealingPool::steal(size_t thief)
+{
+    const size_t workers = threads_.size();
+
+    for (;;)
+    {
+        // pick the victim with the most work left
+        size_t victim = workers;
+        uint64_t victimRange = 0;
+        uint32_t most = 0;
+        for (size_t id = 0; id < workers; ++id)
+        {
+            if (id == thief)
+            {
+                continue;
+            }
+            const uint64_t range = slots_[id].range.load(std::memory_order_acquire);
+            const uint32_t left = endOf(range) - beginOf(range);
+            if (beginOf(range) < endOf(range) && left > most)
+            {
+                most = left;
+                victim = id;
+                victimRange = range;
+            }
+        }
+
+        if (victim == workers)
+        {
+            return false;
+        }
+
+        // victim keeps the front half, thief takes the back half
+        const uint32_t begin = beginOf(victimRange);
+        const uint32_t end = endOf(victimRange);
+        const uint32_t mid = begin + (end - begin) / 2;
+        if (slots_[victim].range.compare_exchange_strong(victimRange, pack(begin, mid), std::memory_order_acq_rel))
+        {
+            // our slot is empty, so nobody else can be stealing from it
+            slots_[thief].range.store(pack(mid, end), std::memory_order_release);
+            return true;
+        }
+    }
+}
+
+} // namespace detail
+
+// ============================================================================
+// BatchParser
+// ============================================================================
+
+namespace
+{
+
+size_t defaultThreads()
+{
+    const unsigned hardware = std::thread::hardware_concurrency();
+    return hardware ? hardware : 1;
+}
+
+BatchResult parseOne(std::string_view input, const ParseOptions& options, std::pmr::memory_resource* upstream)
+{
+    BatchResult result;
+    result.document = WKTDocument::tryParse(input, options, &result.error, upstream);
+    return result;
+}
+
+ParseOptions withScratch(std::pmr::memory_resource* scratch)
+{
+    ParseOptions options;
+    options.scratch = scratch;
+    return options;
+}
+
+} // namespace
+
+BatchParser::BatchParser(size_t threads, std::pmr::memory_resource* upstream)
+    : pool_(std::make_unique<detail::WorkStealingPool>(threads ? threads : defaultThreads()))
+    , upstream_(upstream)
+{
+    // a worker only ever touches its own pool, so no locking
+    for (size_t id = 0; id < pool_->size(); ++id)
+    {
+        scratch_.push_back(std::make_unique<std::pmr::unsynchronized_pool_resource>(upstream_));
+    }
+}
+
+BatchParser::~BatchParser() = default;
+
+size_t BatchParser::threadCount() const
+{
+    return pool_->size();
+}
+
+void BatchParser::parseBuffers(const std::vector<std::string_view>& buffers, const Callback& onResult)
+{
+    pool_->run(buffers.size(), [&](size_t index, size_t worker)
+    {
+        onResult(index, parseOne(buffers[index], withScratch(scratch_[worker].get()), upstream_));
+    });
+}
+
+void BatchParser::parseFiles(const std::vector<std::string>& paths, const Callback& onResult)
+{
+    pool_->run(paths.size(), [&](size_t index, size_t worker)
+    {
+        BatchResult result;
+        result.document = WKTDocument::tryParseFile(paths[index], withScratch(scratch_[worker].get()),
+                                                    &result.error, upstream_);
+        onResult(index, std::move(result));
+    });
+}
+
+void BatchParser::parseStream(std::string_view input, const RecordCallback& onRecord)
+{
+    // a few chunks per worker so stealing can even out dense regions
+    const std::vector<StreamChunk> chunks = WKTStreamReader::split(input, pool_->size() * 4);
+    
+    pool_->run(chunks.size(), [&](size_t index, size_t worker)
+    {
+        WKTStreamReader reader(chunks[index], upstream_, scratch_[worker].get());
+        StreamRecord record;
+        while (reader.next(record))
+        {
+            onRecord(std::move(record));
+        }
+    });
+}
+
+std::vector<BatchResult> BatchParser::parseBuffers(const std::vector<std::string_view>& buffers)
+{
+    std::vector<BatchResult> results(buffers.size());
+    parseBuffers(buffers, [&](size_t index, BatchResult&& result)
+    {
+        results[index] = std::move(result);
+    });
+    return results;
+}
+
+std::vector<BatchResult> BatchParser::parseFiles(const std::vector<std::string>& paths)
+{
+    std::vector<BatchResult> results(paths.size());
+    parseFiles(paths, [&](size_t index, BatchResult&& result)
+    {
+        results[index] = std::move(result);
+    });
+    return results;
+}
+
+} // namespace wkt
@@ -0,0 +1,576 @@
+#include "wkt_parser.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+using namespace wkt;
+
+// ============================================================================
+// Allocation counting
+// ============================================================================
+
+// Every heap allocation of the process goes through here, arena blocks
+// included (the default upstream is new/delete)
+namespace
+{
+std::atomic<uint64_t> g_allocations{0};
+}
+
+void* operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+
+// ============================================================================
+// Corpora
+// ============================================================================
+
+struct Corpus
+{
+    std::string name;
+    std::vector<std::string> documents;
+    size_t bytes = 0;
+    size_t nodes = 0;
+};
+
+std::string number(double value)
+{
+    std::ostringstream out;
+    out << std::setprecision(15) << value;
+    return out.str();
+}
+
+struct Geographic
+{
+    const char* gcs;
+    const char* datum;
+    const char* spheroid;
+    double a;
+    double rf;
+};
+
+constexpr Geographic kGeographic[] =
+{
+    {"GCS_WGS_1984",               "D_WGS_1984",             "WGS_1984",        6378137.0,   298.257223563},
+    {"GCS_North_American_1983",    "D_North_American_1983",  "GRS_1980",        6378137.0,   298.257222101},
+    {"GCS_North_American_1927",    "D_North_American_1927",  "Clarke_1866",     6378206.4,   294.9786982},
+    {"GCS_ETRS_1989",              "D_ETRS_1989",            "GRS_1980",        6378137.0,   298.257222101},
+    {"GCS_Pulkovo_1942",           "D_Pulkovo_1942",         "Krasovsky_1940",  6378245.0,   298.3},
+    {"GCS_European_1950",          "D_European_1950",        "International_1924", 6378388.0, 297.0},
+    {"GCS_OSGB_1936",              "D_OSGB_1936",            "Airy_1830",       6377563.396, 299.3249646},
+};
+
+std::string geogcs(const Geographic& g)
+{
+    return std::string("GEOGCS[\"") + g.gcs + "\",DATUM[\"" + g.datum + "\",SPHEROID[\"" + g.spheroid + "\"," +
+           number(g.a) + "," + number(g.rf) + "]],PRIMEM[\"Greenwich\",0.0],UNIT[\"Degree\",0.0174532925199433]]";
+}
+
+std::string parameter(const char* name, double value)
+{
+    return std::string(",PARAMETER[\"") + name + "\"," + number(value) + "]";
+}
+
+// .prj files as ESRI writes them: geographic systems, UTM and Gauss-Kruger
+// zones, and Lambert conformal conic state-plane-like systems
+Corpus esriCorpus(size_t count)
+{
+    Corpus corpus;
+    corpus.name = "esri";
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Geographic& g = kGeographic[i % (sizeof(kGeographic) / sizeof(kGeographic[0]))];
+        const int zone = int(i % 60) + 1;
+        std::string wkt;
+        switch (i % 4)
+        {
+            case 0:
+                wkt = geogcs(g);
+                break;
+            case 1:
+                wkt = std::string("PROJCS[\"") + g.gcs + "_UTM_Zone_" + std::to_string(zone) + "N\"," + geogcs(g) +
+                      ",PROJECTION[\"Transverse_Mercator\"]" + parameter("False_Easting", 500000) +
+                      parameter("False_Northing", 0) + parameter("Central_Meridian", zone * 6 - 183) +
+                      parameter("Scale_Factor", 0.9996) + parameter("Latitude_Of_Origin", 0) + ",UNIT[\"Meter\",1.0]]";
+                break;
+            case 2:
+            {
+                const int gk = zone % 29 + 4;
+                wkt = "PROJCS[\"Pulkovo_1942_GK_Zone_" + std::to_string(gk) + "\"," + geogcs(kGeographic[4]) +
+                      ",PROJECTION[\"Gauss_Kruger\"]" + parameter("False_Easting", gk * 1e6 + 500000) +
+                      parameter("False_Northing", 0) + parameter("Central_Meridian", gk * 6 - 3) +
+                      parameter("Scale_Factor", 1) + parameter("Latitude_Of_Origin", 0) + ",UNIT[\"Meter\",1.0]]";
+                break;
+            }
+            default:
+                wkt = "PROJCS[\"StatePlane_" + std::to_string(i) + "\"," + geogcs(g) +
+                      ",PROJECTION[\"Lambert_Conformal_Conic\"]" + parameter("False_Easting", 2000000 + i) +
+                      parameter("False_Northing", 0) + parameter("Central_Meridian", -100.5 + zone / 7.0) +
+                      parameter("Standard_Parallel_1", 30.0 + zone / 13.0) +
+                      parameter("Standard_Parallel_2", 33.0 + zone / 11.0) +
+                      parameter("Latitude_Of_Origin", 29.5) +
+                      ",UNIT[\"Foot_US\",0.3048006096012192],AUTHORITY[\"EPSG\"," + std::to_string(2000 + i) + "]]";
+                break;
+        }
+        corpus.documents.push_back(std::move(wkt));
+    }
+    return corpus;
+}
+
+// One section with `width` children
+Corpus wideCorpus(size_t count, size_t width)
+{
+    Corpus corpus;
+    corpus.name = "wide";
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::string wkt = "LOCAL_CS[\"wide_" + std::to_string(i) + "\"";
+        for (size_t j = 0; j < width; ++j)
+        {
+            wkt += parameter(("p_" + std::to_string(j)).c_str(), double(i + j) / 8);
+        }
+        corpus.documents.push_back(wkt + "]");
+    }
+    return corpus;
+}
+
+// A chain `depth` sections deep
+Corpus deepCorpus(size_t count, size_t depth)
+{
+    Corpus corpus;
+    corpus.name = "deep";
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::string wkt;
+        for (size_t j = 0; j < depth; ++j)
+        {
+            wkt += "EXTENSION[\"level_" + std::to_string(j) + "\"," + std::to_string(i + j) + ",";
+        }
+        wkt += "UNIT[\"Meter\",1.0]";
+        wkt.append(depth, ']');
+        corpus.documents.push_back(std::move(wkt));
+    }
+    return corpus;
+}
+
+// Few sections, many numbers each
+Corpus numbersCorpus(size_t count, size_t numbers)
+{
+    Corpus corpus;
+    corpus.name = "numbers";
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::string wkt = "LOCAL_CS[\"numbers\"";
+        for (size_t section = 0; section < 4; ++section)
+        {
+            wkt += ",TOWGS84[";
+            for (size_t j = 0; j < numbers; ++j)
+            {
+                wkt += (j ? "," : "") + number(6378137.0 / double(i + j + section + 1) - 0.5e-3 * double(j));
+            }
+            wkt += "]";
+        }
+        corpus.documents.push_back(wkt + "]");
+    }
+    return corpus;
+}
+
+// Records of a file of concatenated or newline-delimited WKT (e.g. many
+// .prj files joined); malformed records are skipped
+Corpus fileCorpus(const std::string& path)
+{
+    Corpus corpus;
+    corpus.name = path;
+    WKTStreamReader reader = WKTStreamReader::openFile(path);
+    StreamRecord record;
+    size_t skipped = 0;
+    while (reader.nextSpan(record))
+    {
+        if (record.ok())
+        {
+            corpus.documents.emplace_back(record.text);
+        }
+        else
+        {
+            ++skipped;
+        }
+    }
+    if (skipped)
+    {
+        std::cerr << path << ": skipped " << skipped << " malformed records\n";
+    }
+    return corpus;
+}
+
+size_t countNodes(const WKTNode* root)
+{
+    size_t count = 0;
+    std::vector<const WKTNode*> pending{root};
+    while (!pending.empty())
+    {
+        const WKTNode* node = pending.back();
+        pending.pop_back();
+        ++count;
+        for (const auto& child : node->children())
+        {
+            pending.push_back(child.get());
+        }
+    }
+    return count;
+}
+
+void finish(Corpus& corpus)
+{
+    for (const std::string& document : corpus.documents)
+    {
+        corpus.bytes += document.size();
+        corpus.nodes += countNodes(WKTDocument::parse(document).root());
+    }
+}
+
+// ============================================================================
+// Measurement
+// ============================================================================
+
+struct PhaseResult
+{
+    std::string phase;
+    double seconds = 0;          // per pass over the corpus
+    double mbPerSecond = 0;
+    double docsPerSecond = 0;
+    double nsPerNode = 0;
+    double allocationsPerDoc = 0;
+};
+
+// Keeps results observable so the work is not optimized away
+volatile size_t g_sink = 0;
+
+// Runs `body(i)` over every document of the corpus, once to warm up, then
+// in passes until `minSeconds` have gone by; reports the mean pass
+template<typename Body>
+PhaseResult measure(const char* phase, const Corpus& corpus, double minSeconds, Body&& body)
+{
+    using Clock = std::chrono::steady_clock;
+    const size_t count = corpus.documents.size();
+
+    size_t sink = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        sink += body(i);
+    }
+
+    size_t passes = 0;
+    const uint64_t allocationsBefore = g_allocations.load(std::memory_order_relaxed);
+    const auto start = Clock::now();
+    double elapsed = 0;
+    do
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            sink += body(i);
+        }
+        ++passes;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < minSeconds);
+    const uint64_t allocations = g_allocations.load(std::memory_order_relaxed) - allocationsBefore;
+    g_sink = g_sink + sink;
+
+    PhaseResult result;
+    result.phase = phase;
+    result.seconds = elapsed / double(passes);
+    result.mbPerSecond = double(corpus.bytes) / result.seconds / 1e6;
+    result.docsPerSecond = double(count) / result.seconds;
+    result.nsPerNode = result.seconds * 1e9 / double(corpus.nodes);
+    result.allocationsPerDoc = double(allocations) / double(passes * count);
+    return result;
+}
+
+// Lex, parse, find, modify, serialize and areEquivalent, each on its own
+std::vector<PhaseResult> run(const Corpus& corpus, double minSeconds)
+{
+    const size_t count = corpus.documents.size();
+    std::vector<PhaseResult> results;
+
+    results.push_back(measure("lex", corpus, minSeconds, [&](size_t i)
+    {
+        Lexer lexer(corpus.documents[i]);
+        size_t tokens = 0;
+        while (lexer.nextToken().type != TokenType::EndOfInput)
+        {
+            ++tokens;
+        }
+        return tokens;
+    }));
+
+    results.push_back(measure("parse", corpus, minSeconds, [&](size_t i)
+    {
+        return WKTDocument::parse(corpus.documents[i]).root()->children().size();
+    }));
+
+    // the rest work on documents parsed up front
+    std::vector<WKTDocument> parsed;
+    std::vector<WKTDocument> copies;
+    parsed.reserve(count);
+    copies.reserve(count);
+    for (const std::string& document : corpus.documents)
+    {
+        parsed.push_back(WKTDocument::parse(document));
+        copies.push_back(WKTDocument::parse(document));
+    }
+
+    // common queries; in the synthetic corpora they miss and walk the tree
+    const CompiledPath spheroid("DATUM/SPHEROID");
+    const CompiledPath unit("UNIT");
+    results.push_back(measure("find", corpus, minSeconds, [&](size_t i)
+    {
+        const WKTDocument& doc = parsed[i];
+        return size_t(spheroid.find(doc) != nullptr) + size_t(unit.find(doc) != nullptr) +
+               size_t(doc.getParameter(ProjectionParameter::CentralMeridian).has_value());
+    }));
+
+    // every number of the document set once; the copies are edited, so
+    // the other phases keep seeing clean documents
+    std::vector<std::vector<std::pair<WKTNode*, size_t>>> numbers(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::vector<WKTNode*> pending{copies[i].root()};
+        while (!pending.empty())
+        {
+            WKTNode* node = pending.back();
+            pending.pop_back();
+            for (size_t n = 0; n < node->numbers().size(); ++n)
+            {
+                numbers[i].emplace_back(node, n);
+            }
+            for (const auto& child : node->children())
+            {
+                pending.push_back(child.get());
+            }
+        }
+    }
+    double value = 0;
+    results.push_back(measure("modify", corpus, minSeconds, [&](size_t i)
+    {
+        value += 0.125;
+        for (const auto& [node, index] : numbers[i])
+        {
+            node->setNumber(index, value);
+        }
+        return numbers[i].size();
+    }));
+
+    results.push_back(measure("serialize", corpus, minSeconds, [&](size_t i)
+    {
+        return parsed[i].toString().size();
+    }));
+
+    // equal pairs: every hash gate passes and the whole tree is compared
+    std::vector<WKTDocument> twins;
+    twins.reserve(count);
+    for (const std::string& document : corpus.documents)
+    {
+        twins.push_back(WKTDocument::parse(document));
+    }
+    results.push_back(measure("areEquivalent", corpus, minSeconds, [&](size_t i)
+    {
+        return size_t(utils::areEquivalent(parsed[i], twins[i], 1e-9));
+    }));
+
+    return results;
+}
+
+// ============================================================================
+// Output
+// ============================================================================
+
+void printTable(const Corpus& corpus, const std::vector<PhaseResult>& results)
+{
+    std::cout << "\n" << corpus.name << ": " << corpus.documents.size() << " documents, " << corpus.bytes
+              << " bytes, " << corpus.nodes << " nodes\n";
+    std::cout << std::left << std::setw(15) << "  phase" << std::right << std::setw(12) << "MB/s" << std::setw(14)
+              << "docs/s" << std::setw(12) << "ns/node" << std::setw(12) << "allocs/doc" << "\n";
+    for (const PhaseResult& r : results)
+    {
+        std::cout << std::left << std::setw(15) << ("  " + r.phase) << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << r.mbPerSecond << std::setw(14) << std::setprecision(0) << r.docsPerSecond
+                  << std::setw(12) << std::setprecision(2) << r.nsPerNode << std::setw(12) << r.allocationsPerDoc
+                  << "\n";
+        std::cout.unsetf(std::ios::floatfield);
+    }
+}
+
+std::string jsonString(std::string_view text)
+{
+    std::string out = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", unsigned(static_cast<unsigned char>(c)));
+            out += escaped;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void writeJson(std::ostream& out, const std::string& label, size_t scale, double minSeconds,
+               const std::vector<std::pair<Corpus, std::vector<PhaseResult>>>& runs)
+{
+    out << std::setprecision(6);
+    out << "{\n  \"label\": " << jsonString(label) << ",\n  \"scale\": " << scale << ",\n  \"min_time\": " << minSeconds
+        << ",\n  \"corpora\": [";
+    for (size_t c = 0; c < runs.size(); ++c)
+    {
+        const auto& [corpus, results] = runs[c];
+        out << (c ? "," : "") << "\n    {\n      \"name\": " << jsonString(corpus.name)
+            << ",\n      \"documents\": " << corpus.documents.size() << ",\n      \"bytes\": " << corpus.bytes
+            << ",\n      \"nodes\": " << corpus.nodes << ",\n      \"phases\": {";
+        for (size_t p = 0; p < results.size(); ++p)
+        {
+            const PhaseResult& r = results[p];
+            out << (p ? "," : "") << "\n        " << jsonString(r.phase) << ": {\"seconds\": " << r.seconds
+                << ", \"mb_per_s\": " << r.mbPerSecond << ", \"docs_per_s\": " << r.docsPerSecond
+                << ", \"ns_per_node\": " << r.nsPerNode << ", \"allocs_per_doc\": " << r.allocationsPerDoc << "}";
+        }
+        out << "\n      }\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void usage()
+{
+    std::cout <<
+        "usage: wkt_bench [options]\n"
+        "  --scale N        corpus size multiplier (default 1)\n"
+        "  --min-time S     seconds to run each phase for, at least one pass (default 0.2)\n"
+        "  --corpus FILE    also benchmark the WKT records of FILE (repeatable)\n"
+        "  --only NAME      run only the named corpus: esri, wide, deep, numbers or a FILE\n"
+        "  --json FILE      write the results as JSON\n"
+        "  --label TEXT     label stored in the JSON, e.g. a commit id\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t scale = 1;
+    double minSeconds = 0.2;
+    std::vector<std::string> files;
+    std::string only;
+    std::string jsonPath;
+    std::string label;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--scale" && hasValue)
+        {
+            scale = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--min-time" && hasValue)
+        {
+            minSeconds = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--corpus" && hasValue)
+        {
+            files.push_back(argv[++i]);
+        }
+        else if (arg == "--only" && hasValue)
+        {
+            only = argv[++i];
+        }
+        else if (arg == "--json" && hasValue)
+        {
+            jsonPath = argv[++i];
+        }
+        else if (arg == "--label" && hasValue)
+        {
+            label = argv[++i];
+        }
+        else
+        {
+            usage();
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+
+    std::vector<Corpus> corpora;
+    corpora.push_back(esriCorpus(2000 * scale));
+    corpora.push_back(wideCorpus(20, 500 * scale));
+    corpora.push_back(deepCorpus(20, 200 * scale));
+    corpora.push_back(numbersCorpus(20, 500 * scale));
+    try
+    {
+        for (const std::string& file : files)
+        {
+            corpora.push_back(fileCorpus(file));
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    std::vector<std::pair<Corpus, std::vector<PhaseResult>>> runs;
+    for (Corpus& corpus : corpora)
+    {
+        if ((!only.empty() && corpus.name != only) || corpus.documents.empty())
+        {
+            continue;
+        }
+        finish(corpus);
+        std::vector<PhaseResult> results = run(corpus, minSeconds);
+        printTable(corpus, results);
+        runs.emplace_back(std::move(corpus), std::move(results));
+    }
+
+    if (!jsonPath.empty())
+    {
+        std::ofstream out(jsonPath);
+        writeJson(out, label, scale, minSeconds, runs);
+        if (!out)
+        {
+            std::cerr << "cannot write " << jsonPath << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
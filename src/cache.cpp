@@ -0,0 +1,274 @@
+#include "wkt_parser.hpp"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+
+namespace wkt
+{
+
+namespace detail
+{
+
+// ============================================================================
+// CacheShard
+// ============================================================================
+
+// One lock's worth of the cache. The ring holds the entries in CLOCK order;
+// the map finds them by content. Keys view the source kept by the entry's
+// own document.
+class alignas(64) CacheShard
+{
+public:
+    using DocumentPtr = std::shared_ptr<const WKTDocument>;
+
+    void setLimits(size_t maxEntries, size_t maxBytes)
+    {
+        maxEntries_ = maxEntries;
+        maxBytes_ = maxBytes;
+    }
+
+    DocumentPtr find(uint64_t hash, std::string_view input) const;
+
+    // Caches `document` unless the same input got there first, and returns
+    // the cached document; `document` itself if it is over the byte budget
+    DocumentPtr insert(uint64_t hash, DocumentPtr document);
+
+    void clear();
+    void addStats(ParseCacheStats& stats) const;
+
+private:
+    struct Key
+    {
+        uint64_t hash;
+        std::string_view text;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const { return static_cast<size_t>(key.hash); }
+    };
+
+    struct KeyEqual
+    {
+        bool operator()(const Key& a, const Key& b) const { return a.hash == b.hash && a.text == b.text; }
+    };
+
+    struct Entry
+    {
+        Entry(const Key& key, DocumentPtr document) : key(key), document(std::move(document)) {}
+
+        Key key;
+        DocumentPtr document;
+        mutable std::atomic<bool> referenced{false};   // set by hits, cleared by the hand
+    };
+
+    using Ring = std::list<Entry>;
+
+    void evictOne();
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<Key, Ring::iterator, KeyHash, KeyEqual> map_;
+    Ring ring_;
+    Ring::iterator hand_ = ring_.end();   // next entry the clock looks at
+    size_t bytes_ = 0;
+    size_t maxEntries_ = 0;
+    size_t maxBytes_ = 0;
+    uint64_t evictions_ = 0;
+    mutable std::atomic<uint64_t> hits_{0};
+    mutable std::atomic<uint64_t> misses_{0};
+};
+
+CacheShard::DocumentPtr CacheShard::find(uint64_t hash, std::string_view input) const
+{
+    std::shared_lock lock(mutex_);
+    const auto it = map_.find(Key{hash, input});
+    if (it == map_.end())
+    {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    // only written when clear, so hot entries keep their cache line shared
+    const Entry& entry = *it->second;
+    if (!entry.referenced.load(std::memory_order_relaxed))
+    {
+        entry.referenced.store(true, std::memory_order_relaxed);
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return entry.document;
+}
+
+CacheShard::DocumentPtr CacheShard::insert(uint64_t hash, DocumentPtr document)
+{
+    const Key key{hash, document->originalSource()};
+
+    std::unique_lock lock(mutex_);
+    const auto it = map_.find(key);
+    if (it != map_.end())
+    {
+        return it->second->document;
+    }
+    if (maxBytes_ > 0 && key.text.size() > maxBytes_)
+    {
+        return document;
+    }
+
+    while (!ring_.empty() && ((maxEntries_ > 0 && map_.size() >= maxEntries_) ||
+                              (maxBytes_ > 0 && bytes_ + key.text.size() > maxBytes_)))
+    {
+        evictOne();
+    }
+
+    // just behind the hand: a full turn before it is looked at
+    const Ring::iterator entry = ring_.emplace(hand_, key, std::move(document));
+    try
+    {
+        map_.emplace(key, entry);
+    }
+    catch (...)
+    {
+        ring_.erase(entry);
+        throw;
+    }
+    bytes_ += key.text.size();
+    return entry->document;
+}
+
+void CacheShard::evictOne()
+{
+    // terminates within one turn: nothing sets the bits under our lock
+    for (;;)
+    {
+        if (hand_ == ring_.end())
+        {
+            hand_ = ring_.begin();
+        }
+
+        Entry& entry = *hand_;
+        if (entry.referenced.load(std::memory_order_relaxed))
+        {
+            entry.referenced.store(false, std::memory_order_relaxed);
+            ++hand_;
+            continue;
+        }
+
+        bytes_ -= entry.key.text.size();
+        map_.erase(entry.key);
+        hand_ = ring_.erase(hand_);
+        ++evictions_;
+        return;
+    }
+}
+
+void CacheShard::clear()
+{
+    std::unique_lock lock(mutex_);
+    map_.clear();
+    ring_.clear();
+    hand_ = ring_.end();
+    bytes_ = 0;
+}
+
+void CacheShard::addStats(ParseCacheStats& stats) const
+{
+    std::shared_lock lock(mutex_);
+    stats.hits += hits_.load(std::memory_order_relaxed);
+    stats.misses += misses_.load(std::memory_order_relaxed);
+    stats.evictions += evictions_;
+    stats.entries += map_.size();
+    stats.bytes += bytes_;
+}
+
+} // namespace detail
+
+// ============================================================================
+// ParseCache
+// ============================================================================
+
+ParseCache::ParseCache(const ParseCacheOptions& options, std::pmr::memory_resource* upstream)
+    : upstream_(upstream)
+{
+    // a power of two, and no more shards than entries, so that every shard
+    // gets at least one
+    size_t count = options.shards > 0 ? options.shards : 1;
+    if (options.maxEntries > 0)
+    {
+        count = std::min(count, options.maxEntries);
+    }
+    while (count & (count - 1))
+    {
+        count &= count - 1;
+    }
+
+    shardCount_ = count;
+    shards_.reset(new detail::CacheShard[count]);
+
+    // even shares, with the remainder one apiece to the first shards, so
+    // the shard limits add up to the cache's
+    auto share = [count](size_t limit, size_t shard) { return limit / count + (shard < limit % count ? 1 : 0); };
+    for (size_t i = 0; i < count; ++i)
+    {
+        const size_t maxBytes = options.maxBytes > 0 ? std::max<size_t>(share(options.maxBytes, i), 1) : 0;
+        shards_[i].setLimits(share(options.maxEntries, i), maxBytes);
+    }
+}
+
+ParseCache::~ParseCache() = default;
+
+detail::CacheShard& ParseCache::shardFor(uint64_t hash) const
+{
+    // the high bits; the shard's map buckets by the low ones
+    return shards_[(hash >> 32) & (shardCount_ - 1)];
+}
+
+ParseCache::DocumentPtr ParseCache::insert(uint64_t hash, WKTDocument&& document)
+{
+    return shardFor(hash).insert(hash, std::make_shared<const WKTDocument>(std::move(document)));
+}
+
+ParseCache::DocumentPtr ParseCache::parse(std::string_view input)
+{
+    const uint64_t hash = detail::hashBytes(input);
+    if (DocumentPtr cached = shardFor(hash).find(hash, input))
+    {
+        return cached;
+    }
+    return insert(hash, WKTDocument::parse(input, upstream_));
+}
+
+ParseCache::DocumentPtr ParseCache::tryParse(std::string_view input, std::string* errorOut)
+{
+    const uint64_t hash = detail::hashBytes(input);
+    if (DocumentPtr cached = shardFor(hash).find(hash, input))
+    {
+        return cached;
+    }
+
+    std::optional<WKTDocument> document = WKTDocument::tryParse(input, errorOut, upstream_);
+    if (!document)
+    {
+        return nullptr;
+    }
+    return insert(hash, std::move(*document));
+}
+
+ParseCacheStats ParseCache::stats() const
+{
+    ParseCacheStats stats;
+    for (size_t i = 0; i < shardCount_; ++i)
+    {
+        shards_[i].addStats(stats);
+    }
+    return stats;
+}
+
+void ParseCache::clear()
+{
+    for (size_t i = 0; i < shardCount_; ++i)
+    {
+        shards_[i].clear();
+    }
+}
+
+} // namespace wkt
@@ -1,6 +1,7 @@
 #include "wkt_parser.hpp"
 #include <sstream>
 #include <cmath>
+#include <system_error>
 
 namespace wkt 
 {
@@ -9,25 +10,185 @@ namespace wkt
 // WKTDocument
 // ============================================================================
 
-WKTDocument WKTDocument::parse(std::string_view input) 
+namespace 
 {
-    WKTDocument doc;
-    doc.source_ = std::string(input);
-    
-    Lexer lexer(input);
-    auto tokens = lexer.tokenize();
-    
-    Parser parser(std::move(tokens));
-    doc.root_ = parser.parse();
+
+// First arena block: room for the source copy plus the node tree, which
+// typically takes a few times the input size
+size_t arenaSizeHint(std::string_view input) 
+{
+    return input.size() * 4 + 1024;
+}
+
+std::optional<std::string_view> toView(const std::optional<std::pmr::string>& value) 
+{
+    if (!value) 
+        return std::nullopt;
+    return std::string_view(*value);
+}
+
+std::optional<std::string_view> sectionValue(const WKTNode* node) 
+{
+    if (node) 
+    {
+        return toView(node->stringValue());
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+WKTDocument::WKTDocument(std::unique_ptr<std::pmr::monotonic_buffer_resource> arena)
+    : arena_(std::move(arena))
+    , source_(arena_.get())
+    , index_(arena_.get())
+    , parameters_(arena_.get())
+{}
+
+namespace 
+{
+
+// pmr containers keep their allocator on assignment, so assigning would copy
+// into our arena; move-constructing takes over other's storage instead
+template<typename T>
+void rebind(T& member, T& from) noexcept 
+{
+    member.~T();
+    new (&member) T(std::move(from));
+}
+
+} // namespace
+
+WKTDocument& WKTDocument::operator=(WKTDocument&& other) noexcept 
+{
+    if (this != &other) 
+    {
+        // Our tree and containers live in arena_, so they let go of it
+        // first; only then is the arena replaced, freeing the old contents
+        (void)root_.release();
+        rebind(parameters_, other.parameters_);
+        rebind(index_, other.index_);
+        rebind(source_, other.source_);
+        arena_ = std::move(other.arena_);
+        root_ = std::move(other.root_);
+        mapping_ = std::move(other.mapping_);
+        indexed_ = other.indexed_;
+    }
+    return *this;
+}
+
+WKTDocument::~WKTDocument() 
+{
+    // Every node, string and child array lives in arena_, so there is
+    // nothing to run per node: dropping the arena frees the whole tree.
+    (void)root_.release();
+}
+
+WKTDocument WKTDocument::parse(std::string_view input, std::pmr::memory_resource* upstream) 
+{
+    return parse(input, ParseOptions{}, upstream);
+}
+
+WKTDocument WKTDocument::parse(std::string_view input, const ParseOptions& options,
+                               std::pmr::memory_resource* upstream) 
+{
+    detail::PhaseScope phase(instrument::Phase::Document, input.size());
+    if (!options.lazy) 
+    {
+        WKTDocument doc(detail::makeArena(upstream, arenaSizeHint(input)));
+        doc.source_.assign(input);
+        doc.parseSource(options.scratch);
+        return doc;
+    }
     
+    // most nodes are never built, so the arena starts at about the source size
+    WKTDocument doc(detail::makeArena(upstream, input.size() + 1024));
+    doc.source_.assign(input);
+    doc.loadLazy(options.validateOnLoad);
+    return doc;
+}
+
+WKTDocument WKTDocument::parseFile(const std::string& path, const ParseOptions& options,
+                                   std::pmr::memory_resource* upstream) 
+{
+    detail::PhaseScope phase(instrument::Phase::Document, 0);
+    WKTDocument doc(detail::makeArena(upstream));
+    doc.mapping_ = detail::loadFile(path, doc.source_);
+    phase.addBytes(doc.originalSource().size());
+    if (options.lazy) 
+        doc.loadLazy(options.validateOnLoad);
+    else 
+        doc.parseSource(options.scratch);
     return doc;
 }
 
-std::optional<WKTDocument> WKTDocument::tryParse(std::string_view input, std::string* errorOut)
+WKTDocument WKTDocument::parseFile(const std::string& path, std::pmr::memory_resource* upstream) 
+{
+    return parseFile(path, ParseOptions{}, upstream);
+}
+
+std::optional<WKTDocument> WKTDocument::tryParseFile(const std::string& path, std::string* errorOut,
+                                                     std::pmr::memory_resource* upstream)
+{
+    return tryParseFile(path, ParseOptions{}, errorOut, upstream);
+}
+
+std::optional<WKTDocument> WKTDocument::tryParseFile(const std::string& path, const ParseOptions& options,
+                                                     std::string* errorOut, std::pmr::memory_resource* upstream)
+{
+    try 
+    {
+        return parseFile(path, options, upstream);
+    }
+    catch (const std::system_error& e) 
+    {
+        if (errorOut) *errorOut = e.what();
+            return std::nullopt;
+    }
+    catch (const LexerError& e) 
+    {
+        if (errorOut) *errorOut = e.what();
+            return std::nullopt;
+    }
+    catch (const ParseError& e) 
+    {
+        if (errorOut) *errorOut = e.what();
+            return std::nullopt;
+    }
+}
+
+void WKTDocument::parseSource(std::pmr::memory_resource* scratch) 
+{
+    // single pass: the parser pulls tokens from the lexer as it goes
+    Lexer lexer(originalSource());
+    Parser parser(lexer, arena_.get());
+    parser.setScratch(scratch);
+    index_.clear();
+    root_ = parser.parse(&index_);
+    buildParameters();
+}
+
+void WKTDocument::buildParameters() 
+{
+    parameters_.clear();
+    for (const WKTNode* projcs : index_.all(names::PROJCS)) 
+    {
+        parameters_.emplace_back(projcs, arena_.get());
+    }
+}
+
+std::optional<WKTDocument> WKTDocument::tryParse(std::string_view input, std::string* errorOut,
+                                                 std::pmr::memory_resource* upstream)
+{
+    return tryParse(input, ParseOptions{}, errorOut, upstream);
+}
+
+std::optional<WKTDocument> WKTDocument::tryParse(std::string_view input, const ParseOptions& options,
+                                                 std::string* errorOut, std::pmr::memory_resource* upstream)
 {
     try 
     {
-        return parse(input);
+        return parse(input, options, upstream);
     }
     catch (const LexerError& e) 
     {
@@ -41,29 +202,29 @@ std::optional<WKTDocument> WKTDocument::tryParse(std::string_view input, std::st
     }
 }
 
-WKTNode* WKTDocument::find(std::string_view path) 
+WKTNode* WKTDocument::find(std::string_view path, NameMatch match) 
 {
     if (!root_) 
         return nullptr;
     
-    const size_t slashPos = path.find('/');
-    std::string_view first = (slashPos == std::string_view::npos) ? path : path.substr(0, slashPos);
+    std::byte buffer[16 * sizeof(SectionName)];
+    std::pmr::monotonic_buffer_resource local(buffer, sizeof(buffer));
+    std::pmr::vector<SectionName> names(&local);
+    if (!names::resolvePath(path, names)) 
+        return nullptr;
     
-    if (root_->name() == first) 
+    // a path may start at the root itself; otherwise it is searched below it
+    if (!names.empty() && names::matches(root_->sectionName(), names[0], match)) 
     {
-        if (slashPos == std::string_view::npos) 
-        {
-            return root_.get();
-        }
-        return root_->findByPath(path.substr(slashPos + 1));
+        return root_->findByNames(names.data() + 1, names.size() - 1, match);
     }
     
-    return root_->findByPath(path);
+    return root_->findByNames(names.data(), names.size(), match);
 }
 
-const WKTNode* WKTDocument::find(std::string_view path) const 
+const WKTNode* WKTDocument::find(std::string_view path, NameMatch match) const 
 {
-    return const_cast<WKTDocument*>(this)->find(path);
+    return const_cast<WKTDocument*>(this)->find(path, match);
 }
 
 bool WKTDocument::setValue(std::string_view sectionName, std::string_view value) 
@@ -72,7 +233,7 @@ bool WKTDocument::setValue(std::string_view sectionName, std::string_view value)
     if (!node) 
         return false;
     
-    node->setStringValue(std::string(value));
+    node->setStringValue(value);
     return true;
 }
 
@@ -104,6 +265,34 @@ bool WKTDocument::setNumbers(std::string_view sectionName, const std::vector<dou
     return true;
 }
 
+SerializeOptions WKTDocument::withSource(const SerializeOptions& options) const 
+{
+    SerializeOptions resolved = options;
+    if (resolved.source.empty()) 
+    {
+        resolved.source = originalSource();
+    }
+    return resolved;
+}
+
+void WKTDocument::serialize(OutputSink& sink, const SerializeOptions& options) const 
+{
+    if (root_) 
+    {
+        root_->serialize(sink, withSource(options));
+    }
+}
+
+size_t WKTDocument::serializedSize(const SerializeOptions& options) const 
+{
+    return root_ ? root_->serializedSize(withSource(options)) : 0;
+}
+
+std::string WKTDocument::toString(const SerializeOptions& options) const 
+{
+    return root_ ? root_->toString(withSource(options)) : std::string();
+}
+
 std::string WKTDocument::toString(bool pretty) const 
 {
     if (!root_) 
@@ -111,36 +300,118 @@ std::string WKTDocument::toString(bool pretty) const
     return root_->toString(pretty ? 2 : -1);
 }
 
+void WKTDocument::reindex() 
+{
+    index_.rebuild(root_.get());
+    indexed_ = true;
+    buildParameters();
+}
+
+const SectionIndex& WKTDocument::sections() const 
+{
+    if (!indexed_) 
+        const_cast<WKTDocument*>(this)->expandAll();
+    return index_;
+}
+
+const WKTNode* WKTDocument::firstSection(NameId name) const 
+{
+    if (indexed_) 
+        return index_.first(name);
+    
+    // the node the index would record: what find(name) returns
+    if (!root_) 
+        return nullptr;
+    if (root_->nameId() == name) 
+        return root_.get();
+    const SectionName key = names::key(name);
+    return root_->findByNames(&key, 1);
+}
+
+const ParameterMap& WKTDocument::parameters() const 
+{
+    static const ParameterMap empty;
+    const ParameterMap* found = parameters(firstSection(names::PROJCS));
+    return found ? *found : empty;
+}
+
+const ParameterMap* WKTDocument::parameters(const WKTNode* projcs) const 
+{
+    if (!projcs) 
+        return nullptr;
+    
+    for (ParameterMap& map : const_cast<WKTDocument*>(this)->parameters_) 
+    {
+        if (map.owner() != projcs) 
+            continue;
+        
+        // a PARAMETER was renamed or added through the node: rebuild in place
+        if (projcs->state_ & WKTNode::kParametersStale) 
+        {
+            map = ParameterMap(projcs, arena_.get());
+            const_cast<WKTNode*>(projcs)->state_ &= ~WKTNode::kParametersStale;
+        }
+        return &map;
+    }
+    
+    if (indexed_ || projcs->nameId() != names::PROJCS) 
+        return nullptr;
+    
+    // lazy: a PROJCS of this tree gets its map on first use (the list
+    // keeps maps handed out earlier in place)
+    const WKTNode* top = projcs;
+    while (top->parent()) 
+        top = top->parent();
+    if (top != root_.get()) 
+        return nullptr;
+    return &const_cast<WKTDocument*>(this)->parameters_.emplace_back(projcs, arena_.get());
+}
+
+std::optional<std::string_view> WKTDocument::getProjectionNameView() const 
+{
+    return sectionValue(firstSection(names::PROJECTION));
+}
+
+std::optional<std::string_view> WKTDocument::getDatumNameView() const 
+{
+    return sectionValue(firstSection(names::DATUM));
+}
+
+std::optional<std::string_view> WKTDocument::getSpheroidNameView() const 
+{
+    return sectionValue(firstSection(names::SPHEROID));
+}
+
 std::optional<std::string> WKTDocument::getProjectionName() const
- {
-    if (const WKTNode* proj = find("PROJECTION")) 
+{
+    if (auto name = getProjectionNameView()) 
     {
-        return proj->stringValue();
+        return std::string(*name);
     }
     return std::nullopt;
 }
 
 std::optional<std::string> WKTDocument::getDatumName() const 
 {
-    if (const WKTNode* datum = find("DATUM")) 
+    if (auto name = getDatumNameView()) 
     {
-        return datum->stringValue();
+        return std::string(*name);
     }
     return std::nullopt;
 }
 
 std::optional<std::string> WKTDocument::getSpheroidName() const 
 {
-    if (const WKTNode* spheroid = find("SPHEROID")) 
+    if (auto name = getSpheroidNameView()) 
     {
-        return spheroid->stringValue();
+        return std::string(*name);
     }
     return std::nullopt;
 }
 
 std::optional<std::pair<double, double>> WKTDocument::getSpheroidParams() const 
 {
-    if (const WKTNode* spheroid = find("SPHEROID")) 
+    if (const WKTNode* spheroid = firstSection(names::SPHEROID)) 
     {
         const auto& nums = spheroid->numbers();
         if (nums.size() >= 2) 
@@ -158,39 +429,6 @@ std::optional<std::pair<double, double>> WKTDocument::getSpheroidParams() const
 namespace utils 
 {
 
-std::optional<int> guessEPSG(const WKTDocument& doc) 
-{
-    // basic EPSG guessing based on datum name
-    auto datumName = doc.getDatumName();
-    if (!datumName) 
-        return std::nullopt;
-    
-    // Basic datum -> EPSG mapping for GEOGCS (geographic CRS) only.
-    // For PROJCS (projected CRS), EPSG depends on projection type, zone number, and other parameters - not implemented here.
-    // Example: D_Pulkovo_1942 -> 4284 (GEOGCS)
-    //          but Pulkovo 1942 / Gauss-Kruger zone 19 -> 28419 (PROJCS)
-    static const std::unordered_map<std::string, int> datumToEPSG = 
-    {
-        {"D_WGS_1984", 4326},
-        {"WGS_1984", 4326},
-        {"D_North_American_1983", 4269},
-        {"D_NAD83", 4269},
-        {"D_North_American_1927", 4267},
-        {"D_NAD27", 4267},
-        {"D_ETRS_1989", 4258},
-        {"D_Pulkovo_1942", 4284},
-        {"D_S_JTSK", 4156},
-    };
-    
-    auto it = datumToEPSG.find(*datumName);
-    if (it != datumToEPSG.end()) 
-    {
-        return it->second;
-    }
-    
-    return std::nullopt;
-}
-
 bool validateWKT(std::string_view input, std::string* errorOut) 
 {
     auto result = WKTDocument::tryParse(input, errorOut);
@@ -199,22 +437,28 @@ bool validateWKT(std::string_view input, std::string* errorOut)
 
 bool areEquivalent(const WKTDocument& a, const WKTDocument& b, double tolerance) 
 {
-    // Compare structure recursively
-    std::function<bool(const WKTNode*, const WKTNode*)> compare;
+    const WKTNode* rootA = a.root();
+    const WKTNode* rootB = b.root();
+    if (!rootA || !rootB) 
+        return rootA == rootB;
+    
+    // Equivalent trees always have equal shape hashes, and equal exact
+    // hashes when no tolerance applies; most non-equivalent pairs stop here
+    if (rootA->shapeHash() != rootB->shapeHash()) 
+        return false;
+    if (!(tolerance > 0.0) && rootA->hash() != rootB->hash()) 
+        return false;
     
-    compare = [&](const WKTNode* nodeA, const WKTNode* nodeB) -> bool 
+    // equal hashes prove nothing: compare node by node
+    std::vector<std::pair<const WKTNode*, const WKTNode*>> pending{{rootA, rootB}};
+    while (!pending.empty()) 
     {
-        if (!nodeA || !nodeB) return nodeA == nodeB;
-        
-        // Compare name
-        if (nodeA->name() != nodeB->name()) 
-            return false;
+        auto [nodeA, nodeB] = pending.back();
+        pending.pop_back();
         
-        // Compare string value
-        if (nodeA->stringValue() != nodeB->stringValue()) 
+        if (nodeA->name() != nodeB->name() || nodeA->stringValue() != nodeB->stringValue()) 
             return false;
         
-        // Compare numbers
         const auto& numsA = nodeA->numbers();
         const auto& numsB = nodeB->numbers();
         if (numsA.size() != numsB.size()) 
@@ -222,29 +466,24 @@ bool areEquivalent(const WKTDocument& a, const WKTDocument& b, double tolerance)
         
         for (size_t i = 0; i < numsA.size(); ++i) 
         {
-            if (std::abs(numsA[i] - numsB[i]) > tolerance) 
+            if (!(std::abs(numsA[i] - numsB[i]) <= tolerance)) 
             {
                 return false;
             }
         }
         
-        // Compare children
         const auto& childrenA = nodeA->children();
         const auto& childrenB = nodeB->children();
-        if (childrenA.size() != childrenB.size()) return false;
+        if (childrenA.size() != childrenB.size()) 
+            return false;
         
         for (size_t i = 0; i < childrenA.size(); ++i) 
         {
-            if (!compare(childrenA[i].get(), childrenB[i].get()))
-            {
-                return false;
-            }
+            pending.emplace_back(childrenA[i].get(), childrenB[i].get());
         }
-        
-        return true;
-    };
+    }
     
-    return compare(a.root(), b.root());
+    return true;
 }
 
 } // namespace utils
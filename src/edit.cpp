@@ -0,0 +1,211 @@
+#include "wkt_parser.hpp"
+#include <algorithm>
+
+namespace wkt
+{
+
+// ============================================================================
+// WKTDocument - incremental reparse
+// ============================================================================
+
+namespace
+{
+
+// The node owns the edit if the edited bytes lie inside its text. A pure
+// insertion on either boundary goes to the parent: it adds text between
+// siblings rather than changing this node.
+bool encloses(size_t start, size_t end, const TextEdit& edit)
+{
+    if (edit.start < start || edit.end > end)
+    {
+        return false;
+    }
+    return edit.start != edit.end || (edit.start != start && edit.start != end);
+}
+
+// The child whose text could contain `offset`: the last one starting at or
+// before it (children are in source order)
+WKTNode* childAt(const WKTNode& node, size_t offset)
+{
+    const auto& children = node.children();
+    auto it = std::upper_bound(children.begin(), children.end(), offset,
+                               [](size_t value, const NodePtr& child) { return value < child->sourceStart(); });
+    return it == children.begin() ? nullptr : std::prev(it)->get();
+}
+
+bool containsSection(const WKTNode* root, NameId name)
+{
+    std::vector<const WKTNode*> stack{root};
+    while (!stack.empty())
+    {
+        const WKTNode* node = stack.back();
+        stack.pop_back();
+        if (node->nameId() == name)
+        {
+            return true;
+        }
+        for (const auto& child : node->children())
+        {
+            stack.push_back(child.get());
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+NodePtr WKTDocument::parseRange(size_t start, size_t end)
+{
+    Lexer lexer(std::string_view(source_).substr(start, end - start));
+    Parser parser(lexer, arena_.get());
+    NodePtr node = parser.parse();
+
+    // parsed relative to `start` (the node may not fill the range if the
+    // edit left blanks at either end); its children stay relative to it
+    node->setSourceRange(start + node->sourceStart(), start + node->sourceEnd());
+    return node;
+}
+
+void WKTDocument::replaceNode(WKTNode* node, NodePtr replacement, size_t delta)
+{
+    WKTNode* parent = node->parent_;
+    const size_t oldEnd = node->sourceEnd();
+
+    // Pivot every ancestor's children at the edited branch: the later
+    // siblings then count from the ancestor's end and move with it, and
+    // nothing inside them is touched. Successive edits in one place find
+    // the pivots already there.
+    for (WKTNode *child = node, *ancestor = parent; ancestor; child = ancestor, ancestor = ancestor->parent_)
+    {
+        ancestor->pivotChildren(ancestor->childIndex(child));
+    }
+
+    // keep the old subtree alive until the index has let go of it
+    NodePtr& slot = parent->children_[parent->childIndex(node)];
+    NodePtr removed = std::move(slot);
+    replacement->sourceStart_ -= parent->sourceStart();
+    replacement->parent_ = parent;
+    slot = std::move(replacement);
+    parent->invalidateHash();
+
+    // every ancestor grows by the size change, as do offsets of numbers
+    // written after the edited child; unsigned wrap-around handles shrinking
+    for (WKTNode* ancestor = parent; ancestor; ancestor = ancestor->parent_)
+    {
+        const size_t start = ancestor->sourceStart();
+        for (WKTNode::Lexeme& lexeme : ancestor->lexemes_)
+        {
+            if (lexeme.length > 0 && start + lexeme.offset >= oldEnd)
+            {
+                lexeme.offset += uint32_t(delta);
+            }
+        }
+        ancestor->sourceLength_ += delta;
+    }
+
+    index_.replace(removed.get(), slot.get());
+    updateParameters(removed.get(), slot.get());
+    removed->parent_ = nullptr;
+}
+
+void WKTDocument::updateParameters(const WKTNode* removed, const WKTNode* inserted)
+{
+    // a PROJCS coming or going changes the set of maps
+    if (containsSection(removed, names::PROJCS) || containsSection(inserted, names::PROJCS))
+    {
+        buildParameters();
+        return;
+    }
+
+    // otherwise only a PARAMETER directly under a PROJCS matters
+    const WKTNode* parent = inserted->parent();
+    if (parent->nameId() != names::PROJCS)
+    {
+        return;
+    }
+    for (ParameterMap& map : parameters_)
+    {
+        if (map.owner() == parent && !map.replaceParameter(removed, inserted))
+        {
+            map = ParameterMap(parent, arena_.get());
+        }
+    }
+}
+
+WKTNode* WKTDocument::applyEdit(const TextEdit& edit)
+{
+    if (edit.start > edit.end || edit.end > originalSource().size())
+    {
+        throw std::out_of_range("applyEdit: range outside the document source");
+    }
+    if (root_ && !root_->isClean())
+    {
+        throw std::logic_error("applyEdit: the tree has edits its source does not reflect");
+    }
+
+    // the edit shifts the source under unexpanded nodes
+    expandAll();
+
+    // mapped files are copied once; edits happen in source_
+    if (mapping_)
+    {
+        source_.assign(mapping_->view());
+        mapping_.reset();
+    }
+
+    // smallest enclosing node, and the path down to it
+    std::vector<WKTNode*> path;
+    if (root_ && encloses(root_->sourceStart(), root_->sourceEnd(), edit))
+    {
+        path.push_back(root_.get());
+        while (WKTNode* child = childAt(*path.back(), edit.start))
+        {
+            if (!encloses(child->sourceStart(), child->sourceEnd(), edit))
+            {
+                break;
+            }
+            path.push_back(child);
+        }
+    }
+
+    const std::string removedText(std::string_view(source_).substr(edit.start, edit.end - edit.start));
+    source_.replace(edit.start, edit.end - edit.start, edit.text);
+    const size_t delta = edit.text.size() - removedText.size();   // wraps when shrinking
+
+    // innermost first; the root itself is re-parsed as a whole document
+    for (size_t level = path.size(); level-- > 1;)
+    {
+        WKTNode* node = path[level];
+        const size_t start = node->sourceStart();
+        const size_t end = node->sourceEnd() + delta;
+        try
+        {
+            NodePtr replacement = parseRange(start, end);
+            WKTNode* result = replacement.get();
+            replaceNode(node, std::move(replacement), delta);
+            return result;
+        }
+        catch (const LexerError&) {}
+        catch (const ParseError&) {}
+    }
+
+    try
+    {
+        Lexer lexer(source_);
+        Parser parser(lexer, arena_.get());
+        SectionIndex index(arena_.get());
+        NodePtr root = parser.parse(&index);
+
+        root_ = std::move(root);
+        index_ = std::move(index);
+        buildParameters();
+        return root_.get();
+    }
+    catch (...)
+    {
+        source_.replace(edit.start, edit.text.size(), removedText);
+        throw;
+    }
+}
+
+} // namespace wkt
@@ -0,0 +1,628 @@
+#include "wkt_parser.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace wkt
+{
+
+// ============================================================================
+// EPSG table
+// ============================================================================
+
+namespace
+{
+
+enum class Datum : uint8_t
+{
+    WGS84,
+    NAD83,
+    NAD27,
+    ETRS89,
+    Pulkovo1942,
+    SJTSK,
+    ED50,
+    OSGB36,
+    GDA94,
+};
+
+struct DatumInfo
+{
+    Datum datum;
+    int code;                  // geographic CRS
+    double semiMajorAxis;
+    double inverseFlattening;
+    std::string_view aliases[4];   // normalized (see normalize), after a "D_" prefix is dropped
+};
+
+constexpr DatumInfo kDatums[] =
+{
+    {Datum::WGS84,       4326, 6378137.0,   298.257223563,     {"wgs1984", "wgs84", "worldgeodeticsystem1984"}},
+    {Datum::NAD83,       4269, 6378137.0,   298.257222101,     {"northamerican1983", "nad83", "nad1983", "northamericandatum1983"}},
+    {Datum::NAD27,       4267, 6378206.4,   294.978698213898,  {"northamerican1927", "nad27", "nad1927", "northamericandatum1927"}},
+    {Datum::ETRS89,      4258, 6378137.0,   298.257222101,     {"etrs1989", "etrs89", "europeanterrestrialreferencesystem1989"}},
+    {Datum::Pulkovo1942, 4284, 6378245.0,   298.3,             {"pulkovo1942"}},
+    {Datum::SJTSK,       4156, 6377397.155, 299.1528128,       {"sjtsk", "systemjednotnetrigonometrickesitekatastralni"}},
+    {Datum::ED50,        4230, 6378388.0,   297.0,             {"european1950", "ed50", "europeandatum1950"}},
+    {Datum::OSGB36,      4277, 6377563.396, 299.3249646,       {"osgb1936", "osgb36"}},
+    {Datum::GDA94,       4283, 6378137.0,   298.257222101,     {"gda1994", "gda94", "geocentricdatumofaustralia1994"}},
+};
+
+enum class Method : uint8_t
+{
+    None,                 // geographic
+    TransverseMercator,
+};
+
+constexpr std::pair<std::string_view, Method> kMethods[] =
+{
+    {"transversemercator", Method::TransverseMercator},
+    {"gausskruger",        Method::TransverseMercator},
+};
+
+// Transverse Mercator zones: zone z of a family is code + z, with
+// central meridian cmStep * z + cmOffset and false easting
+// feStep * z + feOffset
+struct Family
+{
+    int code;
+    Datum datum;
+    int firstZone;
+    int lastZone;
+    double cmStep;
+    double cmOffset;
+    double feStep;
+    double feOffset;
+    double falseNorthing;
+    double scaleFactor;
+    double latitudeOfOrigin;
+};
+
+constexpr Family kFamilies[] =
+{
+    {32600, Datum::WGS84,        1, 60, 6, -183, 0,       500000,  0,        0.9996,       0},    // WGS 84 / UTM zone zN
+    {32700, Datum::WGS84,        1, 60, 6, -183, 0,       500000,  10000000, 0.9996,       0},    // WGS 84 / UTM zone zS
+    {26900, Datum::NAD83,        1, 23, 6, -183, 0,       500000,  0,        0.9996,       0},    // NAD83 / UTM zone zN
+    {26700, Datum::NAD27,        1, 22, 6, -183, 0,       500000,  0,        0.9996,       0},    // NAD27 / UTM zone zN
+    {25800, Datum::ETRS89,      28, 38, 6, -183, 0,       500000,  0,        0.9996,       0},    // ETRS89 / UTM zone zN
+    {23000, Datum::ED50,        28, 38, 6, -183, 0,       500000,  0,        0.9996,       0},    // ED50 / UTM zone zN
+    {28300, Datum::GDA94,       48, 58, 6, -183, 0,       500000,  10000000, 0.9996,       0},    // GDA94 / MGA zone z
+    {28400, Datum::Pulkovo1942,  4, 32, 6, -3,   1000000, 500000,  0,        1,            0},    // Pulkovo 1942 / Gauss-Kruger zone z
+    {28460, Datum::Pulkovo1942,  4, 32, 6, -3,   0,       500000,  0,        1,            0},    // Pulkovo 1942 / Gauss-Kruger zN
+    {27700, Datum::OSGB36,       0,  0, 0, -2,   0,       400000, -100000,   0.9996012717, 49},   // OSGB 1936 / British National Grid
+};
+
+// ============================================================================
+// Signatures
+// ============================================================================
+
+// What tells EPSG codes apart, in canonical units: lengths in metres,
+// angles in degrees, absent parameters at their defaults
+struct Signature
+{
+    Datum datum = Datum::WGS84;
+    Method method = Method::None;
+    double unit = 0;   // metres per linear unit; 0 for geographic
+    std::array<double, kProjectionParameterCount> parameters{};
+};
+
+// Quantum per parameter, fine enough to keep real definitions apart and
+// coarse enough to absorb the digits writers round differently
+constexpr double kQuantum[kProjectionParameterCount] =
+{
+    1e-3,    // FalseEasting, m
+    1e-3,    // FalseNorthing, m
+    1e-7,    // CentralMeridian, degrees
+    1e-7,    // LatitudeOfOrigin
+    1e-10,   // ScaleFactor
+    1e-7,    // StandardParallel1
+    1e-7,    // StandardParallel2
+    1e-7,    // Azimuth
+};
+
+// Categorical part of a signature: datum and method, and the unit rounded
+// to a millionth
+using BucketKey = std::array<int64_t, 2>;
+
+// A whole signature with its numbers rounded to their quanta
+using Key = std::array<int64_t, 2 + kProjectionParameterCount>;
+
+struct FieldsHash
+{
+    template<size_t N>
+    size_t operator()(const std::array<int64_t, N>& fields) const
+    {
+        return size_t(detail::hashBytes(std::string_view(reinterpret_cast<const char*>(fields.data()),
+                                                         sizeof(fields))));
+    }
+};
+
+BucketKey bucketOf(Datum datum, Method method, double unit)
+{
+    return {int64_t(datum) << 8 | int64_t(method), std::llround(unit * 1e6)};
+}
+
+Key keyOf(const Signature& signature)
+{
+    Key key;
+    key[0] = int64_t(signature.datum) << 8 | int64_t(signature.method);
+    key[1] = std::llround(signature.unit * 1e9);
+    for (size_t i = 0; i < kProjectionParameterCount; ++i)
+    {
+        key[2 + i] = std::llround(signature.parameters[i] / kQuantum[i]);
+    }
+    return key;
+}
+
+Signature geographic(Datum datum)
+{
+    Signature signature;
+    signature.datum = datum;
+    return signature;
+}
+
+Signature transverseMercator(const Family& family, int zone)
+{
+    Signature signature;
+    signature.datum = family.datum;
+    signature.method = Method::TransverseMercator;
+    signature.unit = 1;
+    auto& p = signature.parameters;
+    p[size_t(ProjectionParameter::FalseEasting)] = family.feStep * zone + family.feOffset;
+    p[size_t(ProjectionParameter::FalseNorthing)] = family.falseNorthing;
+    p[size_t(ProjectionParameter::CentralMeridian)] = family.cmStep * zone + family.cmOffset;
+    p[size_t(ProjectionParameter::LatitudeOfOrigin)] = family.latitudeOfOrigin;
+    p[size_t(ProjectionParameter::ScaleFactor)] = family.scaleFactor;
+    return signature;
+}
+
+constexpr size_t kCentralMeridian = size_t(ProjectionParameter::CentralMeridian);
+
+struct Candidate
+{
+    int code;
+    Signature signature;
+};
+
+// Every code in the table, twice: by exact key, and in buckets of equal
+// categorical keys sorted by central meridian for range searches
+struct EpsgIndex
+{
+    std::unordered_map<Key, int, FieldsHash> exact;
+    std::unordered_map<BucketKey, std::vector<Candidate>, FieldsHash> buckets;
+
+    void add(int code, const Signature& signature)
+    {
+        exact.emplace(keyOf(signature), code);
+        buckets[bucketOf(signature.datum, signature.method, signature.unit)].push_back({code, signature});
+    }
+};
+
+// Built on first use
+const EpsgIndex& epsgIndex()
+{
+    static const EpsgIndex index = []
+    {
+        EpsgIndex table;
+        for (const DatumInfo& info : kDatums)
+        {
+            table.add(info.code, geographic(info.datum));
+        }
+        for (const Family& family : kFamilies)
+        {
+            for (int zone = family.firstZone; zone <= family.lastZone; ++zone)
+            {
+                table.add(family.code + zone, transverseMercator(family, zone));
+            }
+        }
+        for (auto& [key, candidates] : table.buckets)
+        {
+            std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+            {
+                return a.signature.parameters[kCentralMeridian] < b.signature.parameters[kCentralMeridian];
+            });
+        }
+        return table;
+    }();
+    return index;
+}
+
+// ============================================================================
+// Reading a CRS
+// ============================================================================
+
+// ASCII letters (lower-cased) and digits only
+std::string normalize(std::string_view name)
+{
+    std::string result;
+    result.reserve(name.size());
+    for (char c : name)
+    {
+        if (c >= 'A' && c <= 'Z')
+        {
+            result.push_back(static_cast<char>(c - 'A' + 'a'));
+        }
+        else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+        {
+            result.push_back(c);
+        }
+    }
+    return result;
+}
+
+const DatumInfo* findDatum(std::string_view name)
+{
+    if (name.substr(0, 2) == "D_")
+    {
+        name.remove_prefix(2);
+    }
+    const std::string normalized = normalize(name);
+    for (const DatumInfo& info : kDatums)
+    {
+        for (std::string_view alias : info.aliases)
+        {
+            if (!alias.empty() && alias == normalized)
+            {
+                return &info;
+            }
+        }
+    }
+    return nullptr;
+}
+
+std::optional<Method> findMethod(std::string_view name)
+{
+    const std::string normalized = normalize(name);
+    for (const auto& [alias, method] : kMethods)
+    {
+        if (alias == normalized)
+        {
+            return method;
+        }
+    }
+    return std::nullopt;
+}
+
+// First number of a child section, if it has one
+std::optional<double> firstNumber(const WKTNode* node, NameId name)
+{
+    const WKTNode* child = node->findChild(name);
+    if (!child || child->numbers().empty())
+    {
+        return std::nullopt;
+    }
+    return child->numbers()[0];
+}
+
+// What a document says about its CRS, in canonical units, before it is
+// compared with the table
+struct Description
+{
+    Signature signature;                 // its datum is meaningful only if `datum` is set
+    const DatumInfo* datum = nullptr;    // by name; null if the name is not known
+    bool hasSpheroid = false;
+    double semiMajorAxis = 0;
+    double inverseFlattening = 0;
+    size_t unknownParameters = 0;        // PARAMETERs left out of the signature
+};
+
+// nullopt if the document is not a GEOGCS or PROJCS that any code in the
+// table could describe: no GEOGCS, a prime meridian other than Greenwich,
+// a geographic unit other than degrees, or an unknown projection method
+std::optional<Description> describe(const WKTDocument& doc)
+{
+    const WKTNode* crs = doc.root();
+    if (!crs || (crs->nameId() != names::GEOGCS && crs->nameId() != names::PROJCS))
+    {
+        return std::nullopt;
+    }
+    const bool projected = crs->nameId() == names::PROJCS;
+
+    const WKTNode* geogcs = projected ? crs->findChild(names::GEOGCS) : crs;
+    const WKTNode* datumNode = geogcs ? geogcs->findChild(names::DATUM) : nullptr;
+    if (!datumNode)
+    {
+        return std::nullopt;
+    }
+
+    Description description;
+    if (datumNode->stringValue())
+    {
+        description.datum = findDatum(*datumNode->stringValue());
+    }
+    if (description.datum)
+    {
+        description.signature.datum = description.datum->datum;
+    }
+    if (const WKTNode* spheroid = datumNode->findChild(names::SPHEROID))
+    {
+        const auto& numbers = spheroid->numbers();
+        if (numbers.size() >= 2)
+        {
+            description.hasSpheroid = true;
+            description.semiMajorAxis = numbers[0];
+            description.inverseFlattening = numbers[1];
+        }
+    }
+
+    if (firstNumber(geogcs, names::PRIMEM).value_or(0.0) != 0.0)
+    {
+        return std::nullopt;
+    }
+
+    // angles are converted from the GEOGCS unit (radians per unit)
+    constexpr double kDegree = 3.14159265358979323846 / 180;
+    const double degrees = firstNumber(geogcs, names::UNIT).value_or(kDegree) / kDegree;
+    if (!projected)
+    {
+        if (!(std::abs(degrees - 1) <= 1e-9))
+        {
+            return std::nullopt;
+        }
+        return description;
+    }
+
+    const WKTNode* projection = crs->findChild(names::PROJECTION);
+    const std::optional<Method> method =
+        projection && projection->stringValue() ? findMethod(*projection->stringValue()) : std::nullopt;
+    if (!method)
+    {
+        return std::nullopt;
+    }
+
+    Signature& signature = description.signature;
+    signature.method = *method;
+    signature.unit = firstNumber(crs, names::UNIT).value_or(1.0);
+
+    auto& p = signature.parameters;
+    p[size_t(ProjectionParameter::ScaleFactor)] = 1;
+
+    std::vector<ParameterValue> values;
+    if (const ParameterMap* map = doc.parameters(crs))
+    {
+        map->extract(values);
+    }
+    std::array<bool, kProjectionParameterCount> seen{};
+    for (const ParameterValue& value : values)
+    {
+        if (value.key == ProjectionParameter::Unknown || std::isnan(value.value))
+        {
+            ++description.unknownParameters;
+            continue;
+        }
+        const size_t i = size_t(value.key);
+        if (seen[i])
+        {
+            continue;
+        }
+        seen[i] = true;
+
+        switch (value.key)
+        {
+            case ProjectionParameter::FalseEasting:
+            case ProjectionParameter::FalseNorthing:
+                p[i] = value.value * signature.unit;
+                break;
+            case ProjectionParameter::ScaleFactor:
+                p[i] = value.value;
+                break;
+            default:
+                p[i] = value.value * degrees;
+                break;
+        }
+    }
+    return description;
+}
+
+// The signature exactly as the table would hold it; nullopt if the datum is
+// unknown, a parameter could tell codes apart that the signature does not
+// cover, or the spheroid is not the datum's
+std::optional<Signature> exactSignature(const Description& description)
+{
+    const DatumInfo* datum = description.datum;
+    if (!datum || description.unknownParameters > 0)
+    {
+        return std::nullopt;
+    }
+    if (description.hasSpheroid &&
+        (!(std::abs(description.semiMajorAxis - datum->semiMajorAxis) <= 1e-3) ||
+         !(std::abs(description.inverseFlattening - datum->inverseFlattening) <= 1e-7)))
+    {
+        return std::nullopt;
+    }
+    return description.signature;
+}
+
+// ============================================================================
+// Nearest-neighbour matching
+// ============================================================================
+
+// Confidence factors for what the distance does not measure
+constexpr double kInferredDatum = 0.8;       // datum found by its spheroid, not its name
+constexpr double kUnknownParameter = 0.9;    // per PARAMETER left out of the comparison
+
+// Sums squared differences over their tolerances; false once one is out
+class Distance
+{
+public:
+    bool add(double a, double b, double tolerance)
+    {
+        const double d = std::abs(a - b) / tolerance;
+        if (!(d <= 1))
+        {
+            return false;
+        }
+        sum_ += d * d;
+        ++count_;
+        return true;
+    }
+
+    double value() const { return count_ ? std::sqrt(sum_ / double(count_)) : 0.0; }
+
+private:
+    double sum_ = 0;
+    size_t count_ = 0;
+};
+
+double parameterTolerance(size_t index, const EpsgTolerance& tolerance)
+{
+    switch (ProjectionParameter(index))
+    {
+        case ProjectionParameter::FalseEasting:
+        case ProjectionParameter::FalseNorthing:
+            return tolerance.length;
+        case ProjectionParameter::ScaleFactor:
+            return tolerance.scale;
+        default:
+            return tolerance.angle;
+    }
+}
+
+std::vector<EpsgMatch> nearest(const Description& description, const EpsgTolerance& tolerance, size_t maxResults)
+{
+    std::vector<EpsgMatch> matches;
+
+    // candidate datums: the named one, else every datum the spheroid fits
+    for (const DatumInfo& datum : kDatums)
+    {
+        const bool named = description.datum == &datum;
+        if (description.datum ? !named : !description.hasSpheroid)
+        {
+            continue;
+        }
+
+        Distance spheroid;
+        if (description.hasSpheroid &&
+            (!spheroid.add(description.semiMajorAxis, datum.semiMajorAxis, tolerance.length) ||
+             !spheroid.add(description.inverseFlattening, datum.inverseFlattening, tolerance.inverseFlattening)))
+        {
+            continue;
+        }
+
+        const Signature& wanted = description.signature;
+        const auto& buckets = epsgIndex().buckets;
+        const auto bucket = buckets.find(bucketOf(datum.datum, wanted.method, wanted.unit));
+        if (bucket == buckets.end())
+        {
+            continue;
+        }
+
+        // range search on the central meridian, then every parameter
+        const std::vector<Candidate>& candidates = bucket->second;
+        const double cm = wanted.parameters[kCentralMeridian];
+        auto it = std::lower_bound(candidates.begin(), candidates.end(), cm - tolerance.angle,
+                                   [](const Candidate& candidate, double value)
+                                   {
+                                       return candidate.signature.parameters[kCentralMeridian] < value;
+                                   });
+        for (; it != candidates.end() && it->signature.parameters[kCentralMeridian] <= cm + tolerance.angle; ++it)
+        {
+            Distance distance = spheroid;
+            bool within = true;
+            for (size_t i = 0; i < kProjectionParameterCount && within; ++i)
+            {
+                within = distance.add(wanted.parameters[i], it->signature.parameters[i],
+                                      parameterTolerance(i, tolerance));
+            }
+            if (!within)
+            {
+                continue;
+            }
+
+            EpsgMatch match;
+            match.code = it->code;
+            match.distance = distance.value();
+            match.confidence = 1 - match.distance / 2;
+            if (!named)
+            {
+                match.confidence *= kInferredDatum;
+            }
+            match.confidence *= std::pow(kUnknownParameter, double(description.unknownParameters));
+            matches.push_back(match);
+        }
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const EpsgMatch& a, const EpsgMatch& b)
+    {
+        return a.distance != b.distance ? a.distance < b.distance : a.confidence > b.confidence;
+    });
+
+    // candidates the distance cannot tell apart share the confidence
+    for (size_t first = 0; first < matches.size();)
+    {
+        size_t last = first + 1;
+        while (last < matches.size() && matches[last].distance == matches[first].distance &&
+               matches[last].confidence == matches[first].confidence)
+        {
+            ++last;
+        }
+        for (size_t i = first; i < last; ++i)
+        {
+            matches[i].confidence /= double(last - first);
+        }
+        first = last;
+    }
+
+    if (matches.size() > maxResults)
+    {
+        matches.resize(maxResults);
+    }
+    return matches;
+}
+
+} // namespace
+
+// ============================================================================
+// Utility functions - EPSG
+// ============================================================================
+
+namespace utils
+{
+
+std::optional<int> guessEPSG(const WKTDocument& doc, double* confidence)
+{
+    const std::optional<Description> description = describe(doc);
+    if (!description)
+    {
+        return std::nullopt;
+    }
+
+    if (const std::optional<Signature> signature = exactSignature(*description))
+    {
+        const auto& exact = epsgIndex().exact;
+        const auto it = exact.find(keyOf(*signature));
+        if (it != exact.end())
+        {
+            if (confidence)
+            {
+                *confidence = 1.0;
+            }
+            return it->second;
+        }
+    }
+
+    const std::vector<EpsgMatch> matches = nearest(*description, EpsgTolerance{}, 1);
+    if (matches.empty())
+    {
+        return std::nullopt;
+    }
+    if (confidence)
+    {
+        *confidence = matches[0].confidence;
+    }
+    return matches[0].code;
+}
+
+std::vector<EpsgMatch> matchEPSG(const WKTDocument& doc, const EpsgTolerance& tolerance, size_t maxResults)
+{
+    const std::optional<Description> description = describe(doc);
+    if (!description || maxResults == 0)
+    {
+        return {};
+    }
+    return nearest(*description, tolerance, maxResults);
+}
+
+} // namespace utils
+
+} // namespace wkt
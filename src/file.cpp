@@ -0,0 +1,152 @@
+#include "wkt_parser.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define WKT_HAVE_MMAP 1
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace wkt
+{
+
+namespace detail
+{
+
+// ============================================================================
+// MappedFile
+// ============================================================================
+
+#if WKT_HAVE_MMAP
+
+MappedFile::~MappedFile()
+{
+    ::munmap(data_, size_);
+}
+
+namespace
+{
+
+[[noreturn]] void throwIoError(const std::string& what, const std::string& path)
+{
+    throw std::system_error(errno, std::generic_category(), what + " " + path);
+}
+
+class FileDescriptor
+{
+public:
+    explicit FileDescriptor(int fd) : fd_(fd) {}
+    ~FileDescriptor() { if (fd_ >= 0) ::close(fd_); }
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return fd_; }
+
+private:
+    int fd_;
+};
+
+} // namespace
+
+std::unique_ptr<MappedFile> loadFile(const std::string& path, std::pmr::string& buffer)
+{
+    FileDescriptor file(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (file.get() < 0)
+    {
+        throwIoError("Cannot open file:", path);
+    }
+
+    struct stat info{};
+    if (::fstat(file.get(), &info) != 0)
+    {
+        throwIoError("Cannot stat file:", path);
+    }
+
+    const bool regular = S_ISREG(info.st_mode);
+    const size_t size = regular ? static_cast<size_t>(info.st_size) : 0;
+
+    if (regular && size >= kMapThreshold)
+    {
+        void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.get(), 0);
+        if (data != MAP_FAILED)
+        {
+            ::madvise(data, size, MADV_SEQUENTIAL);
+            return std::make_unique<MappedFile>(data, size);
+        }
+        // fall back to reading, e.g. on filesystems without mmap support
+    }
+
+    // tiny files, pipes and character devices: read() straight into the buffer
+    // one spare byte lets the final zero-length read finish without growing
+    buffer.clear();
+    buffer.resize(regular ? size + 1 : size_t(4096));
+    size_t used = 0;
+    for (;;)
+    {
+        if (used == buffer.size())
+        {
+            buffer.resize(std::max(buffer.size() * 2, size_t(4096)));
+        }
+
+        const ssize_t got = ::read(file.get(), &buffer[used], buffer.size() - used);
+        if (got < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throwIoError("Cannot read file:", path);
+        }
+        if (got == 0)
+        {
+            break;
+        }
+        used += static_cast<size_t>(got);
+    }
+    buffer.resize(used);
+
+    return nullptr;
+}
+
+#else
+
+MappedFile::~MappedFile() = default;
+
+std::unique_ptr<MappedFile> loadFile(const std::string& path, std::pmr::string& buffer)
+{
+    // no mmap on this platform: always read
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        throw std::system_error(errno, std::generic_category(), "Cannot open file: " + path);
+    }
+
+    buffer.clear();
+    char chunk[65536];
+    size_t read = 0;
+    while ((read = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        buffer.append(chunk, read);
+    }
+
+    const bool failed = std::ferror(file) != 0;
+    std::fclose(file);
+    if (failed)
+    {
+        throw std::system_error(EIO, std::generic_category(), "Cannot read file: " + path);
+    }
+
+    return nullptr;
+}
+
+#endif
+
+} // namespace detail
+
+} // namespace wkt
@@ -0,0 +1,209 @@
+#include "wkt_parser.hpp"
+
+namespace wkt
+{
+
+// ============================================================================
+// FlatTree
+// ============================================================================
+
+FlatTree FlatTree::parse(std::string_view input)
+{
+    FlatTree tree;
+    tree.source_.assign(input);
+
+    // lex the tree's own copy so every span is an offset into source_
+    Lexer lexer(tree.source_);
+    Parser parser(lexer);
+    parser.parseFlat(tree);
+
+    return tree;
+}
+
+FlatNode FlatTree::find(std::string_view path, NameMatch match) const
+{
+    if (empty())
+        return FlatNode();
+
+    std::byte buffer[16 * sizeof(SectionName)];
+    std::pmr::monotonic_buffer_resource local(buffer, sizeof(buffer));
+    std::pmr::vector<SectionName> names(&local);
+    if (!names::resolvePath(path, names))
+        return FlatNode();
+
+    const FlatNode top = root();
+    if (!names.empty() && names::matches(top.sectionName(), names[0], match))
+    {
+        return top.findByNames(names.data() + 1, names.size() - 1, match);
+    }
+
+    return top.findByNames(names.data(), names.size(), match);
+}
+
+// ============================================================================
+// FlatNode
+// ============================================================================
+
+std::string_view FlatNode::name() const
+{
+    return tree_->text(FlatTree::Span{tree_->ranges_[index_].offset, tree_->nameLengths_[index_]});
+}
+
+NameId FlatNode::nameId() const
+{
+    return tree_->nameIds_[index_];
+}
+
+SectionName FlatNode::sectionName() const
+{
+    return SectionName{tree_->nameIds_[index_], tree_->foldedIds_[index_], name()};
+}
+
+std::optional<std::string_view> FlatNode::stringValue() const
+{
+    const FlatTree::Span value = tree_->values_[index_];
+    if (value.offset == FlatTree::npos)
+    {
+        return std::nullopt;
+    }
+    return tree_->text(value);
+}
+
+ArrayView<double> FlatNode::numbers() const
+{
+    return ArrayView<double>(tree_->numbers_.data() + tree_->firstNumber_[index_], tree_->numberCount_[index_]);
+}
+
+FlatNode::ChildRange FlatNode::children() const
+{
+    return ChildRange(tree_, tree_->firstChild_[index_]);
+}
+
+size_t FlatNode::sourceStart() const
+{
+    return tree_->ranges_[index_].offset;
+}
+
+size_t FlatNode::sourceEnd() const
+{
+    const FlatTree::Span range = tree_->ranges_[index_];
+    return size_t(range.offset) + range.length;
+}
+
+FlatNode FlatNode::findChild(const SectionName& name, NameMatch match) const
+{
+    const auto& ids = match == NameMatch::Exact ? tree_->nameIds_ : tree_->foldedIds_;
+    const NameId wanted = match == NameMatch::Exact ? name.id : name.folded;
+    const auto& next = tree_->nextSibling_;
+
+    // ids first; the text is only looked at when they agree
+    for (uint32_t child = tree_->firstChild_[index_]; child != FlatTree::npos; child = next[child])
+    {
+        if (ids[child] == wanted && names::matches(FlatNode(tree_, child).sectionName(), name, match))
+        {
+            return FlatNode(tree_, child);
+        }
+    }
+    return FlatNode();
+}
+
+FlatNode FlatNode::findChild(NameId keyword, NameMatch match) const
+{
+    return findChild(names::key(keyword), match);
+}
+
+FlatNode FlatNode::findChild(std::string_view name, NameMatch match) const
+{
+    return findChild(names::key(name), match);
+}
+
+std::vector<FlatNode> FlatNode::findAllChildren(std::string_view name, NameMatch match) const
+{
+    std::vector<FlatNode> result;
+    const SectionName key = names::key(name);
+    for (FlatNode child : children())
+    {
+        if (names::matches(child.sectionName(), key, match))
+        {
+            result.push_back(child);
+        }
+    }
+    return result;
+}
+
+FlatNode FlatNode::findByPath(std::string_view path, NameMatch match) const
+{
+    std::byte buffer[16 * sizeof(SectionName)];
+    std::pmr::monotonic_buffer_resource local(buffer, sizeof(buffer));
+    std::pmr::vector<SectionName> names(&local);
+    if (!names::resolvePath(path, names))
+    {
+        return FlatNode();
+    }
+    return findByNames(names.data(), names.size(), match);
+}
+
+FlatNode FlatNode::findByNames(const SectionName* names, size_t count, NameMatch match) const
+{
+    // Same search as WKTNode::findByNames, iterative: a frame per node whose
+    // children are being searched for the rest of the path
+    struct Frame
+    {
+        uint32_t next;    // child to search next, or npos
+        size_t segment;   // first name still to match
+    };
+    std::byte buffer[16 * sizeof(Frame)];
+    std::pmr::monotonic_buffer_resource local(buffer, sizeof(buffer));
+    std::pmr::vector<Frame> stack(&local);
+
+    FlatNode node = *this;
+    size_t segment = 0;
+    for (;;)
+    {
+        if (node)
+        {
+            if (segment == count)
+            {
+                return node;
+            }
+
+            // the first child matching the next segment commits the search to it
+            if (FlatNode child = node.findChild(names[segment], match))
+            {
+                node = child;
+                ++segment;
+                continue;
+            }
+
+            // otherwise look for the rest of the path under each child in turn
+            stack.push_back({tree_->firstChild_[node.index_], segment});
+        }
+
+        if (stack.empty())
+        {
+            return FlatNode();
+        }
+        Frame& frame = stack.back();
+        if (frame.next == FlatTree::npos)
+        {
+            stack.pop_back();
+            node = FlatNode();
+            continue;
+        }
+        node = FlatNode(tree_, frame.next);
+        frame.next = tree_->nextSibling_[frame.next];
+        segment = frame.segment;
+    }
+}
+
+size_t FlatNode::ChildRange::size() const
+{
+    size_t count = 0;
+    for (auto it = begin(); it != end(); ++it)
+    {
+        ++count;
+    }
+    return count;
+}
+
+} // namespace wkt
@@ -0,0 +1,235 @@
+#include "wkt_parser.hpp"
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace wkt
+{
+
+// ============================================================================
+// Hashing primitives
+// ============================================================================
+
+namespace
+{
+
+// splitmix64 finalizer, applied once per node or string
+inline uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// One multiply per value; order-sensitive. mix() afterwards spreads the bits.
+inline uint64_t combine(uint64_t hash, uint64_t value)
+{
+    return (((hash << 5) | (hash >> 59)) ^ value) * 0x517CC1B727220A95ull;
+}
+
+// Eight bytes at a time; the length goes in first, so a shorter string
+// never hashes like a prefix of a longer one
+uint64_t hashText(std::string_view text)
+{
+    uint64_t hash = combine(0x9E3779B97F4A7C15ull, text.size());
+    size_t i = 0;
+    for (; i + 8 <= text.size(); i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, text.data() + i, 8);
+        hash = combine(hash, word);
+    }
+    if (i < text.size())
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, text.data() + i, text.size() - i);
+        hash = combine(hash, word);
+    }
+    return mix(hash);
+}
+
+// Keyword names are hashed once; their text never changes
+uint64_t nameHash(const SectionName& name)
+{
+    static const auto keywords = []
+    {
+        std::array<uint64_t, names::KeywordCount> table{};
+        for (NameId id = 0; id < names::KeywordCount; ++id)
+        {
+            table[id] = hashText(names::text(id));
+        }
+        return table;
+    }();
+    return names::isKeyword(name.id) ? keywords[name.id] : hashText(name.text);
+}
+
+inline uint64_t numberBits(double value)
+{
+    // 0.0 == -0.0, so they must hash alike
+    if (value == 0.0)
+    {
+        return 0;
+    }
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline uint64_t bucketBits(double value, double bucket)
+{
+    if (!std::isfinite(value))
+    {
+        return numberBits(value);
+    }
+    return numberBits(std::nearbyint(value / bucket));
+}
+
+// Everything but the numbers and children: name, and value or its absence
+uint64_t headHash(const WKTNode& node)
+{
+    uint64_t hash = nameHash(node.sectionName());
+    const auto& value = node.stringValue();
+    return combine(hash, value ? hashText(*value) : 0x5D0A4E3E2B1C9F87ull);
+}
+
+} // namespace
+
+// ============================================================================
+// WKTNode - structural hashes
+// ============================================================================
+
+void WKTNode::computeHash() const
+{
+    const uint64_t head = headHash(*this);
+
+    uint64_t shape = combine(head, numbers_.size());
+    uint64_t exact = shape;
+    for (double value : numbers_)
+    {
+        exact = combine(exact, numberBits(value));
+    }
+
+    shape = combine(shape, children_.size());
+    exact = combine(exact, children_.size());
+    for (const auto& child : children_)
+    {
+        shape = combine(shape, child->shapeHash_);
+        exact = combine(exact, child->hash_);
+    }
+
+    shapeHash_ = mix(shape);
+    hash_ = mix(exact);
+    hashValid_ = true;
+}
+
+void WKTNode::refreshHash() const
+{
+    // post-order with an explicit stack; only stale subtrees are walked,
+    // and a lazy node is expanded here
+    std::vector<std::pair<const WKTNode*, size_t>> stack{{this, 0}};   // node, next child
+    while (!stack.empty())
+    {
+        auto& [node, next] = stack.back();
+        const auto& children = node->children();
+        while (next < children.size() && children[next]->hashValid_)
+        {
+            ++next;
+        }
+        if (next < children.size())
+        {
+            const WKTNode* child = children[next++].get();
+            stack.emplace_back(child, 0);
+            continue;
+        }
+        node->computeHash();
+        stack.pop_back();
+    }
+}
+
+void WKTNode::invalidateHash()
+{
+    // a stale node's ancestors are stale already
+    for (WKTNode* node = this; node && node->hashValid_; node = node->parent_)
+    {
+        node->hashValid_ = false;
+    }
+}
+
+uint64_t WKTNode::hash() const
+{
+    if (!hashValid_)
+    {
+        refreshHash();
+    }
+    return hash_;
+}
+
+uint64_t WKTNode::shapeHash() const
+{
+    if (!hashValid_)
+    {
+        refreshHash();
+    }
+    return shapeHash_;
+}
+
+uint64_t WKTNode::hash(double bucket) const
+{
+    if (!(bucket > 0.0))
+    {
+        return hash();
+    }
+
+    // post-order with an explicit stack; each frame holds its node's hash
+    // so far, and a finished child is folded into its parent's
+    struct Frame
+    {
+        const WKTNode* node;
+        size_t next;
+        uint64_t hash;
+    };
+    auto open = [bucket](const WKTNode& node)
+    {
+        uint64_t result = combine(headHash(node), node.numbers().size());
+        for (double value : node.numbers())
+        {
+            result = combine(result, bucketBits(value, bucket));
+        }
+        return Frame{&node, 0, combine(result, node.children().size())};
+    };
+
+    std::vector<Frame> stack{open(*this)};
+    for (;;)
+    {
+        Frame& frame = stack.back();
+        const auto& children = frame.node->children();
+        if (frame.next < children.size())
+        {
+            const WKTNode& child = *children[frame.next++];
+            stack.push_back(open(child));
+            continue;
+        }
+
+        const uint64_t done = mix(frame.hash);
+        stack.pop_back();
+        if (stack.empty())
+        {
+            return done;
+        }
+        stack.back().hash = combine(stack.back().hash, done);
+    }
+}
+
+// ============================================================================
+// Content hash
+// ============================================================================
+
+uint64_t detail::hashBytes(std::string_view text)
+{
+    return hashText(text);
+}
+
+} // namespace wkt
@@ -0,0 +1,254 @@
+#include "wkt_parser.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+namespace wkt
+{
+
+// ============================================================================
+// SectionIndex
+// ============================================================================
+
+SectionIndex::SectionIndex(std::pmr::memory_resource* resource)
+    : groups_(resource)
+    , hashedGroups_(resource)
+    , path_(resource)
+{
+    std::fill(std::begin(keywordGroups_), std::end(keywordGroups_), kNoGroup);
+}
+
+void SectionIndex::clear()
+{
+    groups_.clear();
+    hashedGroups_.clear();
+    path_.clear();
+    count_ = 0;
+    std::fill(std::begin(keywordGroups_), std::end(keywordGroups_), kNoGroup);
+}
+
+SectionIndex::Group* SectionIndex::group(const SectionName& name)
+{
+    if (names::isKeyword(name.id))
+    {
+        const uint32_t slot = keywordGroups_[name.id];
+        return slot == kNoGroup ? nullptr : &groups_[slot];
+    }
+
+    auto [it, end] = hashedGroups_.equal_range(name.id);
+    for (; it != end; ++it)
+    {
+        Group& candidate = groups_[it->second];
+        if (candidate.text == name.text)
+        {
+            return &candidate;
+        }
+    }
+    return nullptr;
+}
+
+const SectionIndex::Group* SectionIndex::group(const SectionName& name) const
+{
+    return const_cast<SectionIndex*>(this)->group(name);
+}
+
+WKTNode* SectionIndex::first(const SectionName& name) const
+{
+    Group* found = const_cast<SectionIndex*>(this)->group(name);
+    if (found && found->firstStale)
+    {
+        pickFirst(*found);
+    }
+    return found ? found->first : nullptr;
+}
+
+ArrayView<WKTNode*> SectionIndex::all(const SectionName& name) const
+{
+    const Group* found = group(name);
+    return found ? ArrayView<WKTNode*>(found->all.data(), found->all.size()) : ArrayView<WKTNode*>();
+}
+
+void SectionIndex::add(WKTNode* node, size_t depth)
+{
+    const uint32_t index = count_++;
+    path_.resize(depth + 1);
+    path_[depth] = index;
+
+    Group* existing = group(node->sectionName());
+    if (!existing)
+    {
+        Group& added = addGroup(node->sectionName(), node);
+        added.firstIndex = index;
+        added.firstDepth = uint32_t(depth);
+        added.all.push_back(node);
+        return;
+    }
+
+    existing->all.push_back(node);
+
+    // find() takes a direct child over a deeper match under an earlier
+    // sibling: the new node wins if its parent is an ancestor of the current
+    // pick (which was then visited inside the parent's subtree) and the pick
+    // sits deeper than the new node
+    if (depth > 0 && existing->firstIndex > path_[depth - 1] && existing->firstDepth > depth)
+    {
+        existing->first = node;
+        existing->firstIndex = index;
+        existing->firstDepth = uint32_t(depth);
+    }
+}
+
+SectionIndex::Group& SectionIndex::addGroup(const SectionName& name, WKTNode* node)
+{
+    const auto alloc = groups_.get_allocator();
+    std::pmr::string text(alloc);
+    if (names::isKeyword(name.id))
+    {
+        keywordGroups_[name.id] = uint32_t(groups_.size());
+    }
+    else
+    {
+        text.assign(name.text);
+        hashedGroups_.emplace(name.id, uint32_t(groups_.size()));
+    }
+    groups_.push_back(Group{name.id, std::move(text), node, false, 0, 0, std::pmr::vector<WKTNode*>(alloc)});
+    return groups_.back();
+}
+
+void SectionIndex::rebuild(WKTNode* root)
+{
+    clear();
+    if (!root)
+    {
+        return;
+    }
+
+    // pre-order with an explicit stack; children pushed in reverse
+    std::vector<std::pair<WKTNode*, size_t>> stack{{root, 0}};
+    while (!stack.empty())
+    {
+        auto [node, depth] = stack.back();
+        stack.pop_back();
+        add(node, depth);
+
+        const auto& children = node->children();
+        for (auto it = children.rbegin(); it != children.rend(); ++it)
+        {
+            stack.emplace_back(it->get(), depth + 1);
+        }
+    }
+}
+
+namespace
+{
+
+// find() searches the nodes in pre-order and takes the first direct child
+// matching: the match under the earliest parent, first among its siblings.
+// The root, with no parent, comes before all.
+std::pair<size_t, size_t> pickOrder(const WKTNode* node)
+{
+    const WKTNode* parent = node->parent();
+    return parent ? std::make_pair(parent->sourceStart() + 1, node->sourceStart()) : std::make_pair(size_t(0), size_t(0));
+}
+
+// Pre-order walk of one subtree
+template<typename Node, typename Visit>
+void forEachNode(Node* root, Visit&& visit)
+{
+    std::vector<Node*> stack{root};
+    while (!stack.empty())
+    {
+        Node* node = stack.back();
+        stack.pop_back();
+        visit(node);
+
+        const auto& children = node->children();
+        for (auto it = children.rbegin(); it != children.rend(); ++it)
+        {
+            stack.push_back(it->get());
+        }
+    }
+}
+
+} // namespace
+
+void SectionIndex::replace(const WKTNode* removed, WKTNode* inserted)
+{
+    // per name: how many entries leave, and the entries that replace them
+    struct Change
+    {
+        SectionName name;   // views a node of either subtree
+        size_t removed = 0;
+        std::vector<WKTNode*> added;
+    };
+    std::vector<Change> changes;
+    std::unordered_multimap<NameId, size_t> byName;   // into changes
+    auto changeFor = [&](const SectionName& name) -> Change&
+    {
+        auto [it, end] = byName.equal_range(name.id);
+        for (; it != end; ++it)
+        {
+            if (names::matches(changes[it->second].name, name, NameMatch::Exact))
+            {
+                return changes[it->second];
+            }
+        }
+        byName.emplace(name.id, changes.size());
+        changes.push_back(Change{name, 0, {}});
+        return changes.back();
+    };
+
+    forEachNode(removed, [&](const WKTNode* node) { changeFor(node->sectionName()).removed++; });
+    forEachNode(inserted, [&](WKTNode* node) { changeFor(node->sectionName()).added.push_back(node); });
+
+    const size_t start = removed->sourceStart();
+    for (const Change& change : changes)
+    {
+        Group* target = group(change.name);
+        if (!target)
+        {
+            target = &addGroup(change.name, nullptr);
+        }
+        auto& all = target->all;
+
+        // Entries before the edited subtree start before it; the removed
+        // entries and everything after (shifted) start at or past it
+        auto pos = std::lower_bound(all.begin(), all.end(), start,
+                                    [](const WKTNode* node, size_t offset) { return node->sourceStart() < offset; });
+        const auto end = pos + ptrdiff_t(change.removed);
+        if (std::find(pos, end, target->first) != end)
+        {
+            // find()'s pick is gone; look again when it is asked for
+            target->first = nullptr;
+            target->firstStale = true;
+        }
+        pos = all.erase(pos, end);
+        all.insert(pos, change.added.begin(), change.added.end());
+
+        // otherwise only an added node can take its place
+        if (!target->firstStale)
+        {
+            for (WKTNode* node : change.added)
+            {
+                if (!target->first || pickOrder(node) < pickOrder(target->first))
+                {
+                    target->first = node;
+                }
+            }
+        }
+    }
+}
+
+void SectionIndex::pickFirst(Group& group)
+{
+    group.first = nullptr;
+    for (WKTNode* node : group.all)
+    {
+        if (!group.first || pickOrder(node) < pickOrder(group.first))
+        {
+            group.first = node;
+        }
+    }
+    group.firstStale = false;
+}
+
+} // namespace wkt
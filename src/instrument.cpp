@@ -0,0 +1,296 @@
+#include "wkt_parser.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+
+namespace wkt
+{
+
+const char* instrument::phaseName(Phase phase)
+{
+    switch (phase)
+    {
+        case Phase::Lex:       return "lex";
+        case Phase::Parse:     return "parse";
+        case Phase::Serialize: return "serialize";
+        case Phase::Document:  return "document";
+        default:               return "unknown";
+    }
+}
+
+#if defined(WKT_INSTRUMENT)
+
+namespace
+{
+
+// PhaseStats fields, in declaration order
+enum Field : size_t
+{
+    Calls,
+    Nanoseconds,
+    Bytes,
+    Tokens,
+    Numbers,
+    Nodes,
+    Allocations,
+    Exceptions,
+    FieldCount
+};
+
+static_assert(sizeof(instrument::PhaseStats) == FieldCount * sizeof(uint64_t),
+              "Field must list every PhaseStats member");
+
+constexpr size_t kPhases = size_t(instrument::Phase::Count);
+
+using Totals = std::array<std::array<uint64_t, FieldCount>, kPhases>;
+
+// One thread's totals. Only the owning thread writes them, with a plain
+// load and store (no read-modify-write); snapshot() reads them from others.
+struct ThreadTotals
+{
+    ThreadTotals()
+    {
+        for (auto& phase : values)
+        {
+            for (auto& value : phase)
+            {
+                value.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void add(size_t phase, Field field, uint64_t amount)
+    {
+        std::atomic<uint64_t>& value = values[phase][field];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void addTo(Totals& totals) const
+    {
+        for (size_t p = 0; p < kPhases; ++p)
+        {
+            for (size_t f = 0; f < FieldCount; ++f)
+            {
+                totals[p][f] += values[p][f].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::atomic<uint64_t> values[kPhases][FieldCount];
+};
+
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<const ThreadTotals*> live;
+    Totals retired{};    // threads that have exited
+    Totals baseline{};   // everything at the last reset()
+};
+
+// Never destroyed: threads may still exit after static destruction
+Registry& registry()
+{
+    static Registry* instance = new Registry;
+    return *instance;
+}
+
+// A thread's totals, registered on its first phase; at thread exit they
+// are folded into the retired totals
+struct ThreadSlot
+{
+    ThreadSlot()
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.live.push_back(&totals);
+    }
+
+    ~ThreadSlot()
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        totals.addTo(r.retired);
+        r.live.erase(std::find(r.live.begin(), r.live.end(), &totals));
+    }
+
+    ThreadTotals totals;
+};
+
+ThreadTotals& threadTotals()
+{
+    thread_local ThreadSlot slot;
+    return slot.totals;
+}
+
+// Everything since the process started; the caller holds the lock
+Totals collect(Registry& r)
+{
+    Totals totals = r.retired;
+    for (const ThreadTotals* thread : r.live)
+    {
+        thread->addTo(totals);
+    }
+    return totals;
+}
+
+uint64_t now()
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Forwards to the arena's real upstream, counting the blocks it draws
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream) : upstream_(upstream) {}
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        ++detail::events.allocations;
+        return upstream_->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        upstream_->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* upstream_;
+};
+
+// The counter is a base so that it is built before the arena using it
+struct CountingBase
+{
+    explicit CountingBase(std::pmr::memory_resource* upstream) : counter(upstream) {}
+
+    CountingResource counter;
+};
+
+class CountingArena : private CountingBase, public std::pmr::monotonic_buffer_resource
+{
+public:
+    explicit CountingArena(std::pmr::memory_resource* upstream)
+        : CountingBase(upstream)
+        , monotonic_buffer_resource(&counter)
+    {}
+
+    CountingArena(std::pmr::memory_resource* upstream, size_t initialSize)
+        : CountingBase(upstream)
+        , monotonic_buffer_resource(initialSize, &counter)
+    {}
+};
+
+} // namespace
+
+// ============================================================================
+// Instrumentation - enabled
+// ============================================================================
+
+instrument::Snapshot instrument::snapshot()
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    const Totals totals = collect(r);
+
+    Snapshot result;
+    for (size_t p = 0; p < kPhases; ++p)
+    {
+        uint64_t values[FieldCount];
+        for (size_t f = 0; f < FieldCount; ++f)
+        {
+            values[f] = totals[p][f] - r.baseline[p][f];
+        }
+        PhaseStats& stats = result.phases[p];
+        stats.calls = values[Calls];
+        stats.nanoseconds = values[Nanoseconds];
+        stats.bytes = values[Bytes];
+        stats.tokens = values[Tokens];
+        stats.numbers = values[Numbers];
+        stats.nodes = values[Nodes];
+        stats.allocations = values[Allocations];
+        stats.exceptions = values[Exceptions];
+    }
+    return result;
+}
+
+void instrument::reset()
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.baseline = collect(r);
+}
+
+detail::PhaseScope::PhaseScope(instrument::Phase phase, uint64_t bytes)
+    : phase_(phase)
+    , bytes_(bytes)
+    , start_(now())
+    , events_(events)
+    , exceptions_(std::uncaught_exceptions())
+{}
+
+detail::PhaseScope::~PhaseScope()
+{
+    const uint64_t elapsed = now() - start_;
+    ThreadTotals& totals = threadTotals();
+    const size_t p = size_t(phase_);
+    totals.add(p, Calls, 1);
+    totals.add(p, Nanoseconds, elapsed);
+    totals.add(p, Bytes, bytes_);
+    totals.add(p, Tokens, events.tokens - events_.tokens);
+    totals.add(p, Numbers, events.numbers - events_.numbers);
+    totals.add(p, Nodes, events.nodes - events_.nodes);
+    totals.add(p, Allocations, events.allocations - events_.allocations);
+    if (std::uncaught_exceptions() > exceptions_)
+    {
+        totals.add(p, Exceptions, 1);
+    }
+}
+
+std::unique_ptr<std::pmr::monotonic_buffer_resource> detail::makeArena(std::pmr::memory_resource* upstream,
+                                                                       size_t initialSize)
+{
+    if (initialSize == 0)
+    {
+        return std::make_unique<CountingArena>(upstream);
+    }
+    return std::make_unique<CountingArena>(upstream, initialSize);
+}
+
+#else
+
+// ============================================================================
+// Instrumentation - disabled
+// ============================================================================
+
+instrument::Snapshot instrument::snapshot()
+{
+    return {};
+}
+
+void instrument::reset()
+{
+}
+
+std::unique_ptr<std::pmr::monotonic_buffer_resource> detail::makeArena(std::pmr::memory_resource* upstream,
+                                                                       size_t initialSize)
+{
+    if (initialSize == 0)
+    {
+        return std::make_unique<std::pmr::monotonic_buffer_resource>(upstream);
+    }
+    return std::make_unique<std::pmr::monotonic_buffer_resource>(initialSize, upstream);
+}
+
+#endif
+
+} // namespace wkt
@@ -0,0 +1,281 @@
+#include "wkt_parser.hpp"
+#include <algorithm>
+#include <new>
+
+namespace wkt
+{
+
+namespace detail
+{
+
+// Text of a lazy document, shared by its unexpanded nodes; each reads its
+// own range from it. The load scan records where every section's brackets
+// close, so expanding a node jumps over its children instead of scanning
+// their text again at each level.
+struct LazySource
+{
+    std::string_view text;
+    std::pmr::vector<std::pair<size_t, size_t>> brackets;   // '[' and its ']', by '['
+
+    // Entry of the '[' at `open`; npos if none was recorded
+    size_t section(size_t open) const
+    {
+        auto it = std::lower_bound(brackets.begin(), brackets.end(), open,
+                                   [](const std::pair<size_t, size_t>& b, size_t value) { return b.first < value; });
+        return it != brackets.end() && it->first == open ? size_t(it - brackets.begin()) : std::string_view::npos;
+    }
+
+    // Start of the section named `name` whose '[' is entry `index`: back
+    // over any blanks and the name, without summing offsets up the tree
+    size_t start(size_t index, std::string_view name) const
+    {
+        size_t position = brackets[index].first;
+        while (position > 0 && std::string_view(" \t\r\n").find(text[position - 1]) != std::string_view::npos)
+        {
+            --position;
+        }
+        return position - name.size();
+    }
+};
+
+} // namespace detail
+
+namespace
+{
+
+// The scan found something the grammar does not allow
+struct ScanFailure {};
+
+// Reports invalid input found while scanning at `position`. The grammar
+// check runs over the whole document, so the error is the one an eager
+// parse would throw, even if it lies in a subtree not expanded yet.
+[[noreturn]] void reportInvalid(std::string_view source, size_t position)
+{
+    Lexer lexer(source);
+    Parser(lexer).validate();
+
+    // brackets and grammar disagree; should not happen
+    Token token{};
+    token.type = TokenType::EndOfInput;
+    token.position = position;
+    token.line = 1 + size_t(std::count(source.begin(), source.begin() + position, '\n'));
+    token.column = position - source.substr(0, position).find_last_of('\n');   // npos + 1 == 0
+    throw ParseError("Parse error at line " + std::to_string(token.line) + ", column " +
+                     std::to_string(token.column) + ": Malformed section", token);
+}
+
+} // namespace
+
+// ============================================================================
+// WKTDocument - lazy loading
+// ============================================================================
+
+void WKTDocument::loadLazy(bool validate)
+{
+    // Nodes keep views into the source: keep a copied source out of the
+    // string's inline buffer, which would move along with the document
+    if (!mapping_)
+    {
+        source_.reserve(std::max(source_.size(), sizeof(source_)));
+    }
+
+    const std::string_view text = originalSource();
+    if (validate)
+    {
+        Lexer lexer(text);
+        Parser(lexer).validate();
+    }
+
+    // the source lives in the arena, so its table is never destroyed, only released
+    void* storage = arena_->allocate(sizeof(detail::LazySource), alignof(detail::LazySource));
+    detail::LazySource* source = new (storage) detail::LazySource{text, std::pmr::vector<std::pair<size_t, size_t>>(arena_.get())};
+
+    size_t start = 0;
+    size_t end = 0;
+    std::string_view name;
+    try
+    {
+        // the root alone: its name and where its brackets close
+        Lexer lexer(text);
+        const Token token = lexer.nextToken();
+        if (token.type != TokenType::Identifier || lexer.nextToken().type != TokenType::LBracket)
+        {
+            throw ScanFailure{};
+        }
+        start = token.position;
+        end = lexer.skipSection(&source->brackets) + 1;
+        name = token.value;
+        if (lexer.nextToken().type != TokenType::EndOfInput)
+        {
+            throw ScanFailure{};
+        }
+    }
+    catch (const LexerError&)
+    {
+        reportInvalid(text, start);
+    }
+    catch (const ScanFailure&)
+    {
+        reportInvalid(text, start);
+    }
+
+    index_.clear();
+    parameters_.clear();
+    root_ = WKTNode::create(name, arena_.get());
+    root_->setSourceRange(start, end);
+    root_->lazy_ = source;
+    root_->markParsed();
+    indexed_ = false;
+}
+
+void WKTDocument::expandAll()
+{
+    if (indexed_)
+    {
+        return;
+    }
+
+    // the pre-order walk reads every node's children, expanding it
+    index_.rebuild(root_.get());
+    indexed_ = true;
+
+    // maps handed out before stay valid; the other PROJCS nodes get theirs
+    for (const WKTNode* projcs : index_.all(names::PROJCS))
+    {
+        if (!parameters(projcs))
+        {
+            parameters_.emplace_back(projcs, arena_.get());
+        }
+    }
+}
+
+// ============================================================================
+// WKTNode - expansion
+// ============================================================================
+
+void WKTNode::materialize()
+{
+    const detail::LazySource* source = lazy_;
+    const size_t start = lazySection_ != UINT32_MAX ? source->start(lazySection_, name_.text) : sourceStart();
+    const std::string_view text = source->text.substr(start, sourceLength_);
+
+    // Same content rules as Parser::parseNode; token positions are
+    // relative to the node, as lexeme and child offsets are
+    auto discard = [this]
+    {
+        stringValue_.reset();
+        numbers_.clear();
+        lexemes_.clear();
+        children_.clear();
+    };
+
+    bool failed = false;
+    try
+    {
+        Lexer lexer(text);
+        lexer.nextToken();   // our name and '[', checked by whoever scanned us
+        lexer.nextToken();
+
+        Token token = lexer.nextToken();
+        bool expectComma = false;
+        while (token.type != TokenType::RBracket && token.type != TokenType::EndOfInput)
+        {
+            if (expectComma)
+            {
+                if (token.type == TokenType::Comma)
+                {
+                    token = lexer.nextToken();
+                }
+                if (token.type == TokenType::RBracket)
+                {
+                    break;
+                }
+            }
+
+            switch (token.type)
+            {
+                case TokenType::String:
+                    stringValue_.emplace(token.value, get_allocator());
+                    expectComma = true;
+                    break;
+
+                case TokenType::Number:
+                    if (token.position <= UINT32_MAX && token.value.size() <= UINT32_MAX)
+                    {
+                        lexemes_.resize(numbers_.size());
+                        lexemes_.push_back(Lexeme{uint32_t(token.position), uint32_t(token.value.size())});
+                    }
+                    else if (!lexemes_.empty())
+                    {
+                        lexemes_.emplace_back();
+                    }
+                    numbers_.push_back(token.number);
+                    expectComma = true;
+                    break;
+
+                case TokenType::Identifier:
+                {
+                    // a child: jump past its closing bracket, parse it later
+                    const Token open = lexer.nextToken();
+                    const size_t section = open.type == TokenType::LBracket
+                                           ? source->section(start + open.position) : std::string_view::npos;
+                    if (section == std::string_view::npos)
+                    {
+                        throw ScanFailure{};
+                    }
+                    const size_t end = source->brackets[section].second - start + 1;
+                    lexer.skipTo(end);
+
+                    NodePtr child = create(token.value, resource());
+                    detail::countNode();
+                    child->sourceStart_ = token.position;
+                    child->sourceLength_ = end - token.position;
+                    child->parent_ = this;
+                    child->lazy_ = source;
+                    child->lazySection_ = section < UINT32_MAX ? uint32_t(section) : UINT32_MAX;
+                    child->markParsed();
+                    children_.push_back(std::move(child));
+                    expectComma = true;
+                    break;
+                }
+
+                case TokenType::Comma:
+                    expectComma = false;
+                    break;
+
+                default:
+                    throw ScanFailure{};
+            }
+            token = lexer.nextToken();
+        }
+
+        if (token.type != TokenType::RBracket || token.position + 1 != text.size())
+        {
+            throw ScanFailure{};
+        }
+    }
+    catch (const LexerError&)
+    {
+        failed = true;
+    }
+    catch (const ScanFailure&)
+    {
+        failed = true;
+    }
+    catch (...)
+    {
+        // e.g. std::bad_alloc: drop the partial content, stay unexpanded
+        discard();
+        throw;
+    }
+
+    if (failed)
+    {
+        // stays unexpanded, so the next access reports the error again
+        discard();
+        reportInvalid(source->text, start);
+    }
+    lazy_ = nullptr;
+}
+
+} // namespace wkt
@@ -1,8 +1,13 @@
 #include "wkt_parser.hpp"
-#include <cctype>
+#include <algorithm>
+#include <charconv>
 #include <sstream>
 #include <stdexcept>
 
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+#endif
+
 namespace wkt 
 {
 
@@ -25,6 +30,66 @@ std::string Token::typeName() const
     return "Unknown";
 }
 
+// ============================================================================
+// Number conversion
+// ============================================================================
+
+namespace 
+{
+
+// ASCII-only character classes (no locale lookups)
+inline bool isDigit(char c) 
+{
+    return c >= '0' && c <= '9';
+}
+
+inline bool isAlpha(char c) 
+{
+    const char lower = static_cast<char>(c | 0x20);
+    return lower >= 'a' && lower <= 'z';
+}
+
+inline uint64_t lowBits(size_t count) 
+{
+    return count >= 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+inline unsigned trailingZeros(uint64_t bits) { unsigned long i; _BitScanForward64(&i, bits); return unsigned(i); }
+inline unsigned highestBit(uint64_t bits) { unsigned long i; _BitScanReverse64(&i, bits); return unsigned(i); }
+inline unsigned popCount(uint64_t bits) { return unsigned(__popcnt64(bits)); }
+#else
+inline unsigned trailingZeros(uint64_t bits) { return unsigned(__builtin_ctzll(bits)); }
+inline unsigned highestBit(uint64_t bits) { return 63u - unsigned(__builtin_clzll(bits)); }
+inline unsigned popCount(uint64_t bits) { return unsigned(__builtin_popcountll(bits)); }
+#endif
+
+} // namespace
+
+namespace detail
+{
+
+bool parseDouble(std::string_view text, double& out)
+{
+    const char* first = text.data();
+    const char* last = text.data() + text.size();
+    
+    // from_chars takes no leading '+'
+    if (first != last && *first == '+') 
+    {
+        ++first;
+        if (first != last && (*first == '-' || *first == '+')) 
+        {
+            return false;
+        }
+    }
+    
+    const auto [ptr, ec] = std::from_chars(first, last, out);
+    return ec == std::errc() && ptr == last;
+}
+
+} // namespace detail
+
 // ============================================================================
 // LexerError
 // ============================================================================
@@ -46,6 +111,7 @@ Lexer::Lexer(std::string_view input)
 
 std::vector<Token> Lexer::tokenize() 
 {
+    detail::PhaseScope phase(instrument::Phase::Lex, input_.size() - current_);
     std::vector<Token> tokens;
     
     while (!isAtEnd()) {
@@ -81,20 +147,20 @@ Token Lexer::nextToken()
     // Single-character tokens
     switch (c) 
     {
-        case '[': return makeToken(TokenType::LBracket, "[");
-        case ']': return makeToken(TokenType::RBracket, "]");
-        case ',': return makeToken(TokenType::Comma, ",");
+        case '[': return makeToken(TokenType::LBracket, input_.substr(tokenStart_, 1));
+        case ']': return makeToken(TokenType::RBracket, input_.substr(tokenStart_, 1));
+        case ',': return makeToken(TokenType::Comma, input_.substr(tokenStart_, 1));
         case '"': return readString();
     }
     
     // Identifier (starts with letter or underscore)
-    if (std::isalpha(static_cast<unsigned char>(c)) || c == '_')
+    if (isAlpha(c) || c == '_')
     {
         return readIdentifier();
     }
     
     // Number (starts with digit, minus, plus, or dot)
-    if (std::isdigit(static_cast<unsigned char>(c)) || c == '-' || c == '+' || c == '.') 
+    if (isDigit(c) || c == '-' || c == '+' || c == '.') 
     {
         return readNumber();
     }
@@ -104,23 +170,19 @@ Token Lexer::nextToken()
 
 void Lexer::skipWhitespace() 
 {
+    // jump to the first non-whitespace byte of each block
     while (!isAtEnd()) 
     {
-        char c = peek();
-        switch (c) 
+        const Window w = window(current_);
+        const uint64_t stop = ~w.whitespace & w.valid;
+        const size_t skip = stop ? trailingZeros(stop) : popCount(w.valid);
+        
+        countNewlines(w.newline & lowBits(skip), current_);
+        current_ += skip;
+        
+        if (stop) 
         {
-            case ' ':
-            case '\t':
-            case '\r':
-                advance();
-                break;
-            case '\n':
-                advance();
-                line_++;
-                column_ = 1;
-                break;
-            default:
-                return;
+            return;
         }
     }
 }
@@ -132,19 +194,17 @@ Token Lexer::readIdentifier()
     
     while (!isAtEnd()) 
     {
-        char c = peek();
-        if (std::isalnum(static_cast<unsigned char>(c)) || c == '_')
-        {
-            advance();
-        }
-        else 
+        const Window w = window(current_);
+        const uint64_t stop = ~w.word & w.valid;
+        if (stop) 
         {
+            current_ += trailingZeros(stop);
             break;
         }
+        current_ += popCount(w.valid);
     }
     
-    std::string value(input_.substr(start, current_ - start));
-    return makeToken(TokenType::Identifier, std::move(value));
+    return makeToken(TokenType::Identifier, input_.substr(start, current_ - start));
 }
 
 Token Lexer::readString() 
@@ -152,29 +212,43 @@ Token Lexer::readString()
     // Opening quote already consumed
     size_t start = current_;
     
-    while (!isAtEnd() && peek() != '"') 
+    // jump between quotes, backslashes and newlines; everything else is body
+    while (!isAtEnd()) 
     {
-        if (peek() == '\n') 
+        const Window w = window(current_);
+        const uint64_t stop = (w.quote | w.escape | w.newline) & w.valid;
+        if (!stop) 
+        {
+            current_ += popCount(w.valid);
+            continue;
+        }
+        
+        current_ += trailingZeros(stop);
+        const char c = input_[current_];
+        if (c == '"') 
+        {
+            break;
+        }
+        if (c == '\n') 
         {
             line_++;
-            column_ = 0;
+            lineStart_ = ++current_;
         }
-        // Handle escape sequences if needed
-        if (peek() == '\\' && current_ + 1 < input_.size()) 
+        else 
         {
-            advance(); // skip backslash
+            // backslash: skip it together with the escaped character
+            current_ += (current_ + 1 < input_.size()) ? 2 : 1;
         }
-        advance();
     }
     
     if (isAtEnd()) {
         error("Unterminated string");
     }
     
-    std::string value(input_.substr(start, current_ - start));
+    const std::string_view value = input_.substr(start, current_ - start);
     advance(); // consume closing quote
     
-    return makeToken(TokenType::String, std::move(value));
+    return makeToken(TokenType::String, value);
 }
 
 Token Lexer::readNumber() 
@@ -183,13 +257,13 @@ Token Lexer::readNumber()
     if (input_[start] == '-' || input_[start] == '+') 
     {
         // need at least one digit after sign
-        if (isAtEnd() || (!std::isdigit(static_cast<unsigned char>(peek())) && peek() != '.')) 
+        if (isAtEnd() || (!isDigit(peek()) && peek() != '.')) 
         {
             error("Invalid number: expected digit after sign");
         }
     }
     
-    while (!isAtEnd() && std::isdigit(static_cast<unsigned char>(peek()))) 
+    while (!isAtEnd() && isDigit(peek())) 
     {
         advance();
     }
@@ -198,7 +272,7 @@ Token Lexer::readNumber()
     {
         advance();
 
-        while (!isAtEnd() && std::isdigit(static_cast<unsigned char>(peek()))) 
+        while (!isAtEnd() && isDigit(peek())) 
         {
             advance();
         }
@@ -216,35 +290,28 @@ Token Lexer::readNumber()
         }
         
         // digits
-        if (isAtEnd() || !std::isdigit(static_cast<unsigned char>(peek()))) 
+        if (isAtEnd() || !isDigit(peek())) 
         {
             error("Invalid number: expected exponent digits");
         }
         
-        while (!isAtEnd() && std::isdigit(static_cast<unsigned char>(peek()))) 
+        while (!isAtEnd() && isDigit(peek())) 
         {
             advance();
         }
     }
     
-    std::string value(input_.substr(start, current_ - start));
+    const std::string_view value = input_.substr(start, current_ - start);
     
-    // validate
-    try 
-    {
-        size_t pos = 0;
-        std::stod(value, &pos);
-        if (pos != value.size()) 
-        {
-            error("Invalid number format: " + value);
-        }
-    } 
-    catch (const std::exception&) 
+    // convert once; the parser takes the value from the token
+    double number = 0.0;
+    if (!detail::parseDouble(value, number)) 
     {
-        error("Invalid number format: " + value);
+        error("Invalid number format: " + std::string(value));
     }
+    detail::countNumber();
     
-    return makeToken(TokenType::Number, std::move(value));
+    return makeToken(TokenType::Number, value, number);
 }
 
 char Lexer::peek() const 
@@ -256,9 +323,7 @@ char Lexer::peek() const
 
 char Lexer::advance() 
 {
-    const char c = input_[current_++];
-    column_++;
-    return c;
+    return input_[current_++];
 }
 
 bool Lexer::isAtEnd() const 
@@ -266,23 +331,146 @@ bool Lexer::isAtEnd() const
     return current_ >= input_.size();
 }
 
-Token Lexer::makeToken(TokenType type, std::string value) 
+void Lexer::skipLine(size_t from) 
+{
+    const size_t newline = input_.find('\n', std::min(from, input_.size()));
+    const size_t target = (newline == std::string_view::npos) ? input_.size() : newline + 1;
+    
+    // keep line numbers right whether this moves forward or back
+    const char* data = input_.data();
+    if (target >= current_) 
+    {
+        line_ += size_t(std::count(data + current_, data + target, '\n'));
+    }
+    else 
+    {
+        line_ -= size_t(std::count(data + target, data + current_, '\n'));
+    }
+    if (newline != std::string_view::npos) 
+    {
+        lineStart_ = target;
+    }
+    
+    current_ = target;
+}
+
+size_t Lexer::skipSection(std::pmr::vector<std::pair<size_t, size_t>>* matches) 
+{
+    size_t depth = 1;
+    bool inString = false;
+    
+    // entries of the brackets still open, innermost last
+    std::vector<size_t> open;
+    if (matches) 
+    {
+        open.push_back(matches->size());
+        matches->emplace_back(current_ - 1, 0);
+    }
+    
+    while (!isAtEnd()) 
+    {
+        const Window w = window(current_);
+        const uint64_t stop = (inString ? (w.quote | w.escape) : (w.bracket | w.quote)) & w.valid;
+        if (!stop) 
+        {
+            countNewlines(w.newline & w.valid, current_);
+            current_ += popCount(w.valid);
+            continue;
+        }
+        
+        const unsigned skip = trailingZeros(stop);
+        countNewlines(w.newline & lowBits(skip), current_);
+        current_ += skip;
+        
+        const char c = input_[current_];
+        if (c == '\\') 
+        {
+            // as in readString: the escaped character is skipped unseen
+            current_ += (current_ + 1 < input_.size()) ? 2 : 1;
+            continue;
+        }
+        
+        ++current_;
+        if (c == '"') 
+        {
+            inString = !inString;
+        }
+        else if (c == '[') 
+        {
+            ++depth;
+            if (matches) 
+            {
+                open.push_back(matches->size());
+                matches->emplace_back(current_ - 1, 0);
+            }
+        }
+        else 
+        {
+            if (matches) 
+            {
+                (*matches)[open.back()].second = current_ - 1;
+                open.pop_back();
+            }
+            if (--depth == 0) 
+            {
+                return current_ - 1;
+            }
+        }
+    }
+    
+    error(inString ? "Unterminated string" : "Unterminated section");
+}
+
+Lexer::Window Lexer::window(size_t pos) 
+{
+    if (pos < blockStart_ || pos >= blockEnd_) 
+    {
+        blockStart_ = pos;
+        blockEnd_ = pos + std::min<size_t>(64, input_.size() - pos);
+        block_ = detail::classifyBlock(input_.data() + pos, blockEnd_ - pos);
+    }
+    
+    const size_t shift = pos - blockStart_;
+    return Window
+    {
+        block_.whitespace >> shift,
+        block_.newline >> shift,
+        block_.quote >> shift,
+        block_.escape >> shift,
+        block_.word >> shift,
+        block_.bracket >> shift,
+        lowBits(blockEnd_ - pos)
+    };
+}
+
+void Lexer::countNewlines(uint64_t newlines, size_t from) 
+{
+    if (newlines) 
+    {
+        line_ += popCount(newlines);
+        lineStart_ = from + highestBit(newlines) + 1;
+    }
+}
+
+Token Lexer::makeToken(TokenType type, std::string_view value, double number) 
 {
+    detail::countToken();
     return Token
     {
         type,
-        std::move(value),
+        value,
         tokenStart_,
         line_,
-        column_
+        column(),
+        number
     };
 }
 
 void Lexer::error(const std::string& msg) 
 {
     std::ostringstream ss;
-    ss << "Lexer error at line " << line_ << ", column " << column_ << ": " << msg;
-    throw LexerError(ss.str(), current_, line_, column_);
+    ss << "Lexer error at line " << line_ << ", column " << column() << ": " << msg;
+    throw LexerError(ss.str(), current_, line_, column());
 }
 
 } // namespace wkt
@@ -1,7 +1,12 @@
 #include "wkt_parser.hpp"
 #include <iostream>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <cstdio>
+#include <functional>
+#include <system_error>
+#include <thread>
 
 using namespace wkt;
 
@@ -16,6 +21,26 @@ using namespace wkt;
     catch (const std::exception& e) { std::cout << "FAILED: " << e.what() << "\n"; failures++; } \
 } while(0)
 
+// same shape, values, source ranges and number spellings
+static bool sameTree(const WKTNode* a, const WKTNode* b) {
+    if (a->nameId() != b->nameId() || a->stringValue() != b->stringValue() || a->numbers() != b->numbers() ||
+        a->sourceStart() != b->sourceStart() || a->sourceEnd() != b->sourceEnd() ||
+        a->children().size() != b->children().size() || !a->isClean()) {
+        return false;
+    }
+    for (size_t i = 0; i < a->numbers().size(); ++i) {
+        if (a->numberLexeme(i).offset != b->numberLexeme(i).offset || a->numberLexeme(i).length != b->numberLexeme(i).length) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < a->children().size(); ++i) {
+        if (a->children()[i]->parent() != a || !sameTree(a->children()[i].get(), b->children()[i].get())) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // ============================================================================
 // lexer tests
 // ============================================================================
@@ -45,6 +70,25 @@ TEST(lexer_numbers) {
     assert(tokens[8].type == TokenType::Number && tokens[8].value == "1.5e-10");
 }
 
+TEST(lexer_number_values) {
+    Lexer lexer("T[6378137.0,-298.257,1.5e-10,+0.5,.25,0.0174532925199433]");
+    auto tokens = lexer.tokenize();
+    
+    // numbers are converted once, in the lexer
+    assert(tokens[2].number == 6378137.0);
+    assert(tokens[4].number == -298.257);
+    assert(tokens[6].number == 1.5e-10);
+    assert(tokens[8].number == 0.5);
+    assert(tokens[10].number == 0.25);
+    assert(tokens[12].number == 0.0174532925199433);
+    
+    for (const char* bad : {"T[1e999]", "T[-]", "T[1.5e]", "T[.]"}) {
+        bool threw = false;
+        try { Lexer(bad).tokenize(); } catch (const LexerError&) { threw = true; }
+        assert(threw);
+    }
+}
+
 TEST(lexer_whitespace) {
     Lexer lexer("GEOGCS [ \"name\" , 123 ]");
     auto tokens = lexer.tokenize();
@@ -57,6 +101,61 @@ TEST(lexer_whitespace) {
     assert(tokens[4].type == TokenType::Number);
 }
 
+TEST(lexer_zero_copy) {
+    const std::string input = "GEOGCS[\"WGS_84\",1.5]";
+    Lexer lexer(input);
+    auto tokens = lexer.tokenize();
+    
+    // every token value is a view into the input
+    for (const auto& token : tokens) {
+        assert(token.value.empty() ||
+               (token.value.data() >= input.data() &&
+                token.value.data() + token.value.size() <= input.data() + input.size()));
+    }
+    assert(tokens[2].value.data() == input.data() + 8);
+    
+    // parse errors keep their own copy of the offending lexeme
+    std::string error;
+    try {
+        std::string broken = "GEOGCS[\"a\"]]";
+        WKTDocument::parse(broken);
+    } catch (const ParseError& e) {
+        ParseError copy = e;
+        error = std::string(copy.token().value);
+    }
+    assert(error == "]");
+}
+
+TEST(lexer_structural_index) {
+    // the vectorized classifier agrees with the scalar one on every byte value
+    std::string bytes;
+    for (int i = 0; i < 1024; ++i) {
+        bytes += static_cast<char>((i * 131 + i / 7) & 0xFF);
+    }
+    for (size_t offset = 0; offset + 64 <= bytes.size(); offset += 13) {
+        for (size_t size : {size_t(64), size_t(63), size_t(17), size_t(1)}) {
+            auto fast = detail::classifyBlock(bytes.data() + offset, size);
+            auto slow = detail::classifyBlockScalar(bytes.data() + offset, size);
+            assert(fast.whitespace == slow.whitespace && fast.newline == slow.newline);
+            assert(fast.quote == slow.quote && fast.escape == slow.escape && fast.word == slow.word);
+            assert(fast.bracket == slow.bracket);
+        }
+    }
+    
+    // tokens that straddle 64-byte blocks, with line tracking across them
+    const std::string padding(70, ' ');
+    const std::string input = "GEOGCS" + padding + "[\"" + std::string(100, 'x') + "\n\\\"y\"," +
+                              padding + "\n\n  " + std::string(80, 'A') + "[1]]";
+    Lexer lexer(input);
+    auto tokens = lexer.tokenize();
+    assert(tokens.size() == 10);
+    assert(tokens[0].value == "GEOGCS");
+    assert(tokens[2].type == TokenType::String && tokens[2].value.size() == 104);
+    assert(tokens[4].value == std::string(80, 'A'));
+    assert(tokens[4].line == 4 && tokens[4].column == 83);
+    assert(tokens[6].number == 1.0);
+}
+
 // ============================================================================
 // parser tests
 // ============================================================================
@@ -132,6 +231,182 @@ TEST(parser_pulkovo) {
     assert(std::abs(params->second - 298.3) < 0.01);
 }
 
+TEST(parser_streaming) {
+    const std::string wkt = 
+        "PROJCS[\"Pulkovo_1942_GK_Zone_19\","
+        "GEOGCS[\"GCS_Pulkovo_1942\",DATUM[\"D_Pulkovo_1942\","
+        "SPHEROID[\"Krasovsky_1940\",6378245.0,298.3]]],"
+        "PROJECTION[\"Gauss_Kruger\"],PARAMETER[\"False_Easting\",19500000.0],"
+        "UNIT[\"Meter\",1.0]]";
+    
+    // pulling tokens on demand builds the same tree as the two-phase path
+    Lexer tokenizer(wkt);
+    Parser twoPhase(tokenizer.tokenize());
+    auto expected = twoPhase.parse();
+    
+    Lexer lexer(wkt);
+    Parser streaming(lexer);
+    auto actual = streaming.parse();
+    
+    assert(expected->toString() == actual->toString());
+    assert(actual->sourceEnd() == wkt.size());
+    
+    // trailing tokens are still rejected in streaming mode
+    Lexer trailing("GEOGCS[\"a\"] GEOGCS[\"b\"]");
+    Parser parser(trailing);
+    bool threw = false;
+    try { parser.parse(); } catch (const ParseError&) { threw = true; }
+    assert(threw);
+}
+
+TEST(parser_arena_allocation) {
+    // upstream resource that counts what the document arena asks for
+    struct CountingResource : std::pmr::memory_resource {
+        size_t allocations = 0;
+        size_t outstanding = 0;
+        
+        void* do_allocate(size_t bytes, size_t align) override {
+            allocations++;
+            outstanding += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, align);
+        }
+        void do_deallocate(void* p, size_t bytes, size_t align) override {
+            outstanding -= bytes;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+    
+    CountingResource upstream;
+    {
+        auto doc = WKTDocument::parse(
+            "PROJCS[\"UTM\",GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\","
+            "SPHEROID[\"WGS_1984\",6378137.0,298.257223563]],PRIMEM[\"Greenwich\",0.0],"
+            "UNIT[\"Degree\",0.0174532925199433]],PROJECTION[\"Transverse_Mercator\"],"
+            "PARAMETER[\"False_Easting\",500000.0],UNIT[\"Meter\",1.0]]",
+            &upstream);
+        
+        // the whole tree comes out of a couple of arena blocks
+        assert(upstream.allocations <= 2);
+        assert(doc.root()->resource() == doc.resource());
+        assert(doc.find("SPHEROID")->resource() == doc.resource());
+        
+        // nodes created elsewhere are copied into the document arena
+        doc.root()->addChild(WKTNode::create("AUTHORITY"));
+        assert(doc.find("AUTHORITY")->resource() == doc.resource());
+        
+        WKTDocument moved = std::move(doc);
+        assert(moved.getDatumName() == "D_WGS_1984");
+        
+        // assignment drops the old arena and takes over the other's
+        moved = WKTDocument::parse("PROJCS[\"B\",PARAMETER[\"Central_Meridian\",9.0]]", &upstream);
+        assert(moved.originalSource() == "PROJCS[\"B\",PARAMETER[\"Central_Meridian\",9.0]]");
+        assert(moved.getParameter("Central_Meridian") == 9.0);
+        assert(moved.sections().first(names::PARAMETER) == moved.find("PARAMETER"));
+        assert(moved.find("PARAMETER")->resource() == moved.resource());
+    }
+    assert(upstream.outstanding == 0);
+    
+    // the open-section stack can come from a scratch pool kept across
+    // parses: once warm, another parse takes nothing new from it
+    std::string deep;
+    for (int i = 0; i < 200; ++i) deep += "N[";
+    deep += std::string(200, ']');
+    CountingResource scratchUpstream;
+    {
+        std::pmr::unsynchronized_pool_resource pool(&scratchUpstream);
+        ParseOptions options;
+        options.scratch = &pool;
+        auto first = WKTDocument::tryParse(deep, options);
+        assert(first && first->root()->toString() == deep);
+        const size_t warm = scratchUpstream.allocations;
+        assert(warm > 0);
+        auto second = WKTDocument::tryParse(deep, options);
+        assert(second && scratchUpstream.allocations == warm);
+    }
+    assert(scratchUpstream.outstanding == 0);
+}
+
+TEST(parser_lazy) {
+    const std::string wkt =
+        "PROJCS[\"UTM [zone 32]\",\n"
+        "  GEOGCS[\"GCS \\\"WGS\\\" ]\",DATUM[\"D_WGS_1984\",SPHEROID[\"WGS_1984\",6378137.0,298.257223563]],\n"
+        "         PRIMEM[\"Greenwich\",0.0],UNIT[\"Degree\",0.0174532925199433],AUTHORITY[\"EPSG\",\"4326\"]],\n"
+        "  PROJECTION[\"Transverse_Mercator\"],,\n"
+        "  PARAMETER[\"False_Easting\",500000.0],PARAMETER[\"Central_Meridian\",9.0],\n"
+        "  UNIT[\"Meter\",1.0] , EMPTY[], NUMBERS[1 2,3e2,]]\n";
+    ParseOptions lazy;
+    lazy.lazy = true;
+    
+    // reading a few fields builds only the nodes on the way
+    auto eager = WKTDocument::parse(wkt);
+    auto doc = WKTDocument::parse(wkt, lazy);
+    assert(!doc.root()->isExpanded());
+    assert(doc.getProjectionName() == "Transverse_Mercator");
+    assert(doc.getParameter(ProjectionParameter::CentralMeridian) == 9.0);
+    assert(doc.root()->isExpanded() && doc.find("PARAMETER")->isExpanded());
+    assert(!doc.root()->children()[0]->isExpanded());
+    
+    // the parameter map handed out survives expansion
+    const ParameterMap& params = doc.parameters();
+    assert(doc.getDatumName() == "D_WGS_1984");
+    assert(!doc.find("AUTHORITY")->isExpanded());
+    doc.expandAll();
+    assert(&doc.parameters() == &params && params.get("False_Easting") == 500000.0);
+    
+    // then it is the eagerly parsed tree, index included
+    assert(sameTree(doc.root(), eager.root()));
+    assert(doc.toString(true) == eager.toString(true));
+    assert(doc.patch().toString() == wkt);
+    assert(doc.sections().all(names::UNIT).size() == eager.sections().all(names::UNIT).size());
+    assert(doc.sections().first(names::UNIT) == doc.find("UNIT"));
+    
+    // sections() expands on its own; the untouched text patches through
+    auto other = WKTDocument::parse(wkt, lazy);
+    other.setNumber("SPHEROID", 0, 6378140.0);
+    assert(other.patch().toString() == std::string(wkt).replace(wkt.find("6378137.0"), 9, "6378140"));
+    assert(other.sections().all(names::PARAMETER).size() == 2);
+    
+    // text edits expand first
+    auto edited = WKTDocument::parse(wkt, lazy);
+    edited.applyEdit(TextEdit{wkt.find("9.0"), wkt.find("9.0") + 3, "15.0"});
+    assert(edited.getParameter("Central_Meridian") == 15.0 && edited.find("AUTHORITY")->isExpanded());
+    
+    // a tiny source moves with the document
+    std::optional<WKTDocument> moved;
+    moved.emplace(WKTDocument::parse("A[1]", lazy));
+    WKTDocument tiny = std::move(*moved);
+    moved.reset();
+    assert(tiny.root()->numbers().size() == 1 && tiny.root()->numbers()[0] == 1.0);
+    
+    // errors: with validation on load, those of an eager parse at load
+    auto errorOf = [](const std::function<void()>& f) {
+        try { f(); } catch (const std::exception& e) { return std::string(e.what()); }
+        return std::string();
+    };
+    const std::string broken = "GEOGCS[\"A\",\n DATUM[\"D\",@],UNIT[\"u\",1]]";
+    const std::string expected = errorOf([&] { WKTDocument::parse(broken); });
+    assert(!expected.empty());
+    ParseOptions validated = lazy;
+    validated.validateOnLoad = true;
+    assert(errorOf([&] { WKTDocument::parse(broken, validated); }) == expected);
+    
+    // without it, when the broken subtree is reached, every time
+    auto deferred = WKTDocument::parse(broken, lazy);
+    assert(deferred.find("UNIT")->numbers()[0] == 1.0);
+    WKTNode* datum = deferred.find("DATUM");
+    assert(errorOf([&] { datum->numbers(); }) == expected);
+    assert(errorOf([&] { datum->children(); }) == expected && !datum->isExpanded());
+    
+    // unbalanced brackets are caught at load either way
+    for (const char* bad : {"GEOGCS[\"A\",DATUM[\"D\"]", "GEOGCS[\"A\"]]", "GEOGCS[\"A]", ""}) {
+        const std::string message = errorOf([&] { WKTDocument::parse(bad); });
+        assert(!message.empty() && errorOf([&] { WKTDocument::parse(bad, lazy); }) == message);
+    }
+}
+
 // ============================================================================
 // real-world wkt samples (from original codebase)
 // ============================================================================
@@ -301,6 +576,267 @@ TEST(navigation_find_by_path) {
     assert(doc.find("SPHEROID")->stringValue() == "S_test");
 }
 
+TEST(navigation_section_names) {
+    // every built-in keyword round-trips through the perfect hash
+    for (NameId id = 0; id < names::KeywordCount; ++id) {
+        assert(names::lookup(names::text(id)) == id);
+        assert(names::key(names::text(id)).id == id);
+    }
+    assert(names::key("SPHEROID").id == names::SPHEROID);
+    assert(!names::lookup("NEVER_SEEN_SECTION_NAME"));
+    
+    // unknown names get a stable id of their own and keep their text
+    const SectionName custom = names::key("ESRI_CUSTOM_SECTION");
+    assert(!names::isKeyword(custom.id) && custom.id == names::key("ESRI_CUSTOM_SECTION").id);
+    assert(custom.text == "ESRI_CUSTOM_SECTION");
+    
+    // case variants are distinct names that fold together
+    const SectionName mixed = names::key("Datum");
+    assert(mixed.id != names::DATUM && mixed.folded == names::DATUM);
+    assert(names::key("my_Ext").folded == names::key("MY_EXT").folded);
+    assert(names::matches(names::key("my_Ext"), names::key("MY_EXT"), NameMatch::IgnoreCase));
+    assert(!names::matches(names::key("my_Ext"), names::key("MY_EXT"), NameMatch::Exact));
+    
+    auto doc = WKTDocument::parse(
+        "GEOGCS[\"GCS_WGS_1984\",Datum[\"D_WGS_1984\",Spheroid[\"WGS_1984\",6378137.0,298.257223563]],"
+        "UNIT[\"Degree\",0.0174532925199433]]");
+    assert(doc.root()->nameId() == names::GEOGCS);
+    assert(doc.find("DATUM/SPHEROID") == nullptr);
+    const WKTNode* spheroid = doc.find("datum/spheroid", NameMatch::IgnoreCase);
+    assert(spheroid && spheroid->name() == "Spheroid");
+    assert(doc.root()->findChild(names::UNIT)->numbers()[0] == 0.0174532925199433);
+    assert(doc.root()->findChild(names::DATUM, NameMatch::IgnoreCase)->name() == "Datum");
+    
+    auto flat = FlatTree::parse(doc.originalSource());
+    assert(flat.root().nameId() == names::GEOGCS);
+    assert(flat.find("datum/SPHEROID", NameMatch::IgnoreCase).stringValue() == "WGS_1984");
+    assert(!flat.find("DATUM"));
+}
+
+TEST(navigation_compiled_path) {
+    const char* wkts[] = {
+        "PROJCS[\"UTM\",GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\",SPHEROID[\"WGS_1984\",6378137.0,298.257223563]],"
+        "UNIT[\"Degree\",0.0174532925199433]],PROJECTION[\"Transverse_Mercator\"],UNIT[\"Meter\",1.0]]",
+        "GEOGCS[\"GCS_Pulkovo_1942\",DATUM[\"D_Pulkovo_1942\",SPHEROID[\"Krasovsky_1940\",6378245.0,298.3]],"
+        "PRIMEM[\"Greenwich\",0.0],UNIT[\"Degree\",0.0174532925199433]]",
+    };
+    const char* paths[] = {"PROJCS/GEOGCS/DATUM/SPHEROID", "GEOGCS/DATUM/SPHEROID", "SPHEROID", "UNIT",
+                           "PROJECTION", "DATUM/MISSING", "GEOGCS/", "PROJCS//UNIT", ""};
+    
+    // Deep search gives exactly what find() gives, on both tree types
+    for (const char* wkt : wkts) {
+        auto doc = WKTDocument::parse(wkt);
+        auto flat = FlatTree::parse(wkt);
+        for (const char* path : paths) {
+            CompiledPath compiled(path);
+            const WKTNode* node = compiled.find(doc);
+            assert(node == doc.find(path));
+            assert(compiled.find(flat) == flat.find(path));
+            assert(compiled.findFrom(doc.root()) == doc.root()->findByPath(path));
+        }
+    }
+    
+    // Anchored: every segment a direct child, no subtree search
+    auto doc = WKTDocument::parse(wkts[0]);
+    CompiledPath deep("SPHEROID");
+    CompiledPath anchored("SPHEROID", NameMatch::Exact, CompiledPath::Search::Anchored);
+    assert(deep.find(doc) && deep.find(doc)->name() == "SPHEROID");
+    assert(!anchored.find(doc));
+    const WKTNode* spheroid = CompiledPath("PROJCS/GEOGCS/DATUM/SPHEROID", NameMatch::Exact,
+                                           CompiledPath::Search::Anchored).find(doc);
+    assert(spheroid && spheroid->numbers()[0] == 6378137.0);
+    assert(CompiledPath("GEOGCS/UNIT", NameMatch::Exact, CompiledPath::Search::Anchored).find(doc)->numbers()[0]
+           == 0.0174532925199433);
+    
+    // compiled before any document used the name
+    CompiledPath custom("geogcs/Compiled_Path_Extension", NameMatch::IgnoreCase);
+    auto later = WKTDocument::parse("GEOGCS[\"x\",COMPILED_PATH_EXTENSION[\"found\"]]");
+    assert(custom.find(later) && *custom.find(later)->stringValue() == "found");
+}
+
+TEST(navigation_section_index) {
+    // random trees over a tiny vocabulary: first() must agree with find()
+    const char* vocabulary[] = {"DATUM", "UNIT", "AXIS", "X_CUSTOM"};
+    unsigned seed = 12345;
+    auto nextRandom = [&seed] { seed = seed * 1103515245u + 12345u; return (seed >> 16) & 0x7fff; };
+    
+    for (int round = 0; round < 200; ++round) {
+        std::string wkt;
+        std::function<void(int)> emit = [&](int depth) {
+            wkt += vocabulary[nextRandom() % 4];
+            wkt += "[";
+            const unsigned children = depth < 4 ? nextRandom() % 4 : 0;
+            for (unsigned c = 0; c < children; ++c) {
+                if (c) wkt += ",";
+                emit(depth + 1);
+            }
+            wkt += "]";
+        };
+        emit(0);
+        
+        auto doc = WKTDocument::parse(wkt);
+        for (const char* name : vocabulary) {
+            const SectionName key = names::key(name);
+            assert(doc.sections().first(key) == doc.find(name));
+            
+            std::vector<WKTNode*> expected;
+            doc.root()->visit([&](WKTNode& node) {
+                if (names::matches(node.sectionName(), key, NameMatch::Exact)) expected.push_back(&node);
+            });
+            ArrayView<WKTNode*> all = doc.sections().all(key);
+            assert(std::vector<WKTNode*>(all.begin(), all.end()) == expected);
+        }
+    }
+    
+    auto doc = WKTDocument::parse(
+        "PROJCS[\"UTM\",GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\",SPHEROID[\"WGS_1984\",6378137.0,298.257223563]]],"
+        "PROJECTION[\"Transverse_Mercator\"],UNIT[\"Meter\",1.0]]");
+    assert(doc.getDatumNameView() == "D_WGS_1984");
+    assert(doc.getSpheroidNameView() == "WGS_1984");
+    assert(doc.getProjectionNameView() == "Transverse_Mercator");
+    assert(doc.getSpheroidParams()->first == 6378137.0);
+    assert(doc.sections().first(names::UNIT)->numbers()[0] == 1.0);
+    assert(doc.sections().all(names::PARAMETER).empty());
+    
+    // the index is part of the document's arena and moves with it
+    doc = WKTDocument::parse("GEOGCS[\"GCS_Pulkovo_1942\",DATUM[\"D_Pulkovo_1942\"]]");
+    assert(doc.getDatumNameView() == "D_Pulkovo_1942");
+    assert(!doc.getProjectionNameView());
+    assert(doc.originalSource() == "GEOGCS[\"GCS_Pulkovo_1942\",DATUM[\"D_Pulkovo_1942\"]]");
+    
+    // structural edits are picked up by reindex()
+    auto projection = WKTNode::create("PROJECTION", doc.resource());
+    projection->setStringValue("Gauss_Kruger");
+    doc.root()->addChild(std::move(projection));
+    assert(!doc.getProjectionName());
+    doc.reindex();
+    assert(doc.getProjectionName() == "Gauss_Kruger");
+}
+
+TEST(navigation_parameters) {
+    auto doc = WKTDocument::parse(
+        "PROJCS[\"Pulkovo_1942_GK_Zone_7\",GEOGCS[\"GCS_Pulkovo_1942\",DATUM[\"D_Pulkovo_1942\"]],"
+        "PROJECTION[\"Gauss_Kruger\"],"
+        "PARAMETER[\"False_Easting\",7500000.0],PARAMETER[\"False_Northing\",0.0],"
+        "PARAMETER[\"Central_Meridian\",39.0],PARAMETER[\"Scale_Factor\",1.0],"
+        "PARAMETER[\"Latitude_Of_Origin\",0.0],PARAMETER[\"Custom_Shift\",12.5],PARAMETER[\"No_Value\"],"
+        "UNIT[\"Meter\",1.0]]");
+    
+    const ParameterMap& params = doc.parameters();
+    assert(params.owner() == doc.root());
+    assert(params.size() == 7);
+    
+    // case, separators and OGC/EPSG aliases
+    assert(doc.getParameter("Central_Meridian") == 39.0);
+    assert(doc.getParameter("central meridian") == 39.0);
+    assert(doc.getParameter("CENTRAL_MERIDIAN") == 39.0);
+    assert(doc.getParameter("Longitude_Of_Natural_Origin") == 39.0);
+    assert(doc.getParameter(ProjectionParameter::FalseEasting) == 7500000.0);
+    assert(params.get("Scale_Factor_At_Natural_Origin") == 1.0);
+    assert(params.get("custom_shift") == 12.5);
+    assert(!params.get("No_Value") && params.find("No_Value"));
+    assert(!params.get("Standard_Parallel_1"));
+    assert(projectionParameter("Latitude_Of_1st_Standard_Parallel") == ProjectionParameter::StandardParallel1);
+    assert(projectionParameter("Custom_Shift") == ProjectionParameter::Unknown);
+    
+    // reads through to the nodes
+    doc.find("PARAMETER")->setNumber(0, 7600000.0);
+    assert(doc.getParameter("False_Easting") == 7600000.0);
+    
+    std::vector<ParameterValue> values;
+    params.extract(values);
+    assert(values.size() == 7);
+    assert(values[2].name == "Central_Meridian" && values[2].key == ProjectionParameter::CentralMeridian);
+    assert(values[5].key == ProjectionParameter::Unknown && values[5].value == 12.5);
+    assert(std::isnan(values[6].value));
+    
+    // no PROJCS: an empty map
+    auto geographic = WKTDocument::parse("GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\"]]");
+    assert(geographic.parameters().empty() && !geographic.getParameter("Central_Meridian"));
+    assert(!geographic.parameters(geographic.root()));
+    
+    // known parameters are indexed however many come before them
+    std::string many = "PROJCS[\"Many\"";
+    for (int i = 0; i < 130; ++i) {
+        many += ",PARAMETER[\"Extra_" + std::to_string(i) + "\"," + std::to_string(i) + "]";
+    }
+    many += ",PARAMETER[\"Central_Meridian\",39.0]]";
+    auto wide = WKTDocument::parse(many);
+    assert(wide.parameters().size() == 131);
+    assert(wide.getParameter(ProjectionParameter::CentralMeridian) == 39.0);
+    assert(wide.getParameter("Longitude_Of_Natural_Origin") == 39.0);
+    assert(wide.getParameter("extra_129") == 129.0);
+}
+
+TEST(navigation_parameters_renamed) {
+    auto doc = WKTDocument::parse(
+        "PROJCS[\"X\",PARAMETER[\"Central_Meridian\",9.0],PARAMETER[\"Custom_Shift\",1.5],UNIT[\"Meter\",1.0]]");
+    const ParameterMap& params = doc.parameters();
+    assert(doc.getParameter("Central_Meridian") == 9.0);
+    
+    // renaming through the document re-keys the map
+    assert(doc.setValue("PARAMETER", "False_Northing"));
+    assert(doc.toString().find("PARAMETER[\"False_Northing\",9]") != std::string::npos);
+    assert(!doc.getParameter("Central_Meridian"));
+    assert(doc.getParameter("False_Northing") == 9.0);
+    assert(doc.getParameter(ProjectionParameter::FalseNorthing) == 9.0);
+    assert(&doc.parameters() == &params);   // rebuilt in place
+    
+    // ... and so does renaming the node itself, known or not
+    WKTNode* custom = doc.root()->findAllChildren("PARAMETER")[1];
+    custom->setStringValue("Central_Meridian");
+    assert(doc.getParameter(ProjectionParameter::CentralMeridian) == 1.5);
+    assert(!doc.getParameter("Custom_Shift"));
+    custom->setStringValue("Other_Shift");
+    assert(doc.getParameter("other_shift") == 1.5);
+    assert(!doc.getParameter(ProjectionParameter::CentralMeridian));
+}
+
+TEST(navigation_flat_tree) {
+    std::string wkt = 
+        "PROJCS[\"UTM\","
+        "GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\",SPHEROID[\"WGS_1984\",6378137.0,298.257223563]],"
+        "PRIMEM[\"Greenwich\",0.0],UNIT[\"Degree\",0.0174532925199433]],"
+        "PROJECTION[\"Transverse_Mercator\"],"
+        "PARAMETER[\"False_Easting\",500000.0],PARAMETER[\"Central_Meridian\",39.0],"
+        "TEST[1,CHILD[2],3],"
+        "UNIT[\"Meter\",1.0]]";
+    
+    auto doc = WKTDocument::parse(wkt);
+    auto flat = FlatTree::parse(wkt);
+    
+    assert(flat.size() == 12);
+    assert(flat.root().name() == "PROJCS");
+    assert(flat.root().children().size() == doc.root()->children().size());
+    
+    // same answers as the pointer-based tree
+    for (const char* path : {"PROJCS", "DATUM", "GEOGCS/DATUM/SPHEROID", "SPHEROID", "UNIT",
+                             "GEOGCS/UNIT", "PARAMETER", "CHILD", "MISSING", "DATUM/MISSING"}) {
+        const WKTNode* node = doc.find(path);
+        FlatNode flatNode = flat.find(path);
+        assert(bool(flatNode) == (node != nullptr));
+        if (!node) continue;
+        
+        assert(flatNode.name() == node->name());
+        assert(flatNode.stringValue().has_value() == node->stringValue().has_value());
+        if (node->stringValue()) assert(*flatNode.stringValue() == *node->stringValue());
+        assert(flatNode.numbers().size() == node->numbers().size());
+        for (size_t i = 0; i < node->numbers().size(); ++i) {
+            assert(flatNode.numbers()[i] == node->numbers()[i]);
+        }
+        assert(flatNode.sourceStart() == node->sourceStart());
+        assert(flatNode.sourceEnd() == node->sourceEnd());
+    }
+    
+    // numbers stay contiguous per node even when interleaved with children
+    FlatNode test = flat.find("TEST");
+    assert(test.numbers().size() == 2 && test.numbers()[0] == 1.0 && test.numbers()[1] == 3.0);
+    assert(test.findChild("CHILD").numbers()[0] == 2.0);
+    
+    assert(flat.root().findAllChildren("PARAMETER").size() == 2);
+    assert(flat.root().findAllChildren("PARAMETER")[1].stringValue() == "Central_Meridian");
+}
+
 // ============================================================================
 // modification tests
 // ============================================================================
@@ -358,6 +894,88 @@ TEST(modification_nested) {
     assert(std::abs(doc.find("SPHEROID")->numbers()[0] - 6378140.0) < 0.1);
 }
 
+TEST(modification_apply_edit) {
+    const std::string wkt =
+        "PROJCS[\"UTM\",\n"
+        "  GEOGCS[\"GCS_WGS_1984\", DATUM[\"D_WGS_1984\", SPHEROID[\"WGS_1984\", 6378137.0, 298.257223563]],\n"
+        "         PRIMEM[\"Greenwich\", 0.0], UNIT[\"Degree\", 0.0174532925199433]],\n"
+        "  PROJECTION[\"Transverse_Mercator\"],\n"
+        "  PARAMETER[\"False_Easting\", 500000.0], PARAMETER[\"Central_Meridian\", 9.0],\n"
+        "  UNIT[\"Meter\", 1.0]]\n";
+
+    // one keystroke: only the enclosing node is re-parsed
+    auto doc = WKTDocument::parse(wkt);
+    const WKTNode* projection = doc.find("PROJECTION");
+    const size_t at = wkt.find("6378137.0") + 1;
+    WKTNode* reparsed = doc.applyEdit({at, at + 1, "4"});
+    assert(reparsed->name() == "SPHEROID" && reparsed->numbers()[0] == 6478137.0);
+    assert(doc.find("PROJECTION") == projection);
+    assert(doc.getSpheroidParams()->first == 6478137.0);
+    assert(doc.patch().toString() == doc.originalSource());
+
+    // an edit that changes the structure widens to the parent
+    const size_t meter = doc.originalSource().find("UNIT[\"Meter\"");
+    reparsed = doc.applyEdit({meter, meter, "PARAMETER[\"False_Northing\", 10.0], "});
+    assert(reparsed == doc.root());
+    assert(doc.getParameter(ProjectionParameter::FalseNorthing) == 10.0);
+
+    // invalid text leaves the document as it was
+    const std::string before(doc.originalSource());
+    bool threw = false;
+    try { doc.applyEdit({0, 6, "PROJCS[["}); } catch (const ParseError&) { threw = true; }
+    assert(threw && doc.originalSource() == before);
+
+    // random edits agree with parsing the edited text from scratch
+    const char* snippets[] = {"", "1", "-", ".5", ",", "]", "[", "\"", "X", " ", "\n", "UNIT[\"u\",2]",
+                              ",AXIS[\"E\",EAST]", "DATUM[\"d\"]", ",7"};
+    unsigned seed = 777;
+    auto nextRandom = [&seed] { seed = seed * 1103515245u + 12345u; return (seed >> 16) & 0x7fff; };
+
+    doc = WKTDocument::parse(wkt);
+    std::string text = wkt;
+    size_t applied = 0;
+    for (int round = 0; round < 3000; ++round) {
+        const size_t start = nextRandom() % (text.size() + 1);
+        const size_t end = std::min(text.size(), start + nextRandom() % 4);
+        const std::string snippet = snippets[nextRandom() % (sizeof(snippets) / sizeof(snippets[0]))];
+
+        std::string edited = text;
+        edited.replace(start, end - start, snippet);
+        auto expected = WKTDocument::tryParse(edited);
+
+        bool failed = false;
+        try { doc.applyEdit({start, end, snippet}); } catch (const std::exception&) { failed = true; }
+        assert(failed == !expected);
+        if (failed) {
+            assert(doc.originalSource() == text);
+            continue;
+        }
+        text = edited;
+        ++applied;
+
+        assert(doc.originalSource() == text);
+        assert(sameTree(doc.root(), expected->root()));
+        for (const char* name : {"UNIT", "DATUM", "PARAMETER", "X"}) {
+            const SectionName key = names::key(name);
+            const WKTNode* first = doc.sections().first(key);
+            const WKTNode* wanted = expected->sections().first(key);
+            assert((first == nullptr) == (wanted == nullptr));
+            assert(!first || first->sourceStart() == wanted->sourceStart());
+            assert(first == doc.root()->findByNames(&key, 1));
+
+            ArrayView<WKTNode*> all = doc.sections().all(key);
+            ArrayView<WKTNode*> wantedAll = expected->sections().all(key);
+            assert(all.size() == wantedAll.size());
+            for (size_t i = 0; i < all.size(); ++i) {
+                assert(all[i]->sourceStart() == wantedAll[i]->sourceStart());
+            }
+        }
+        assert(doc.getParameter(ProjectionParameter::FalseEasting) == expected->getParameter(ProjectionParameter::FalseEasting));
+        assert(doc.patch().toString() == text);
+    }
+    assert(applied > 100);
+}
+
 // ============================================================================
 // serialization tests
 // ============================================================================
@@ -381,6 +999,573 @@ TEST(serialization_pretty) {
     assert(pretty.find('\n') != std::string::npos);
 }
 
+TEST(serialization_sinks) {
+    // enough nodes that the sink writer flushes several times
+    std::string wkt = "PROJCS[\"big\",GEOGCS[\"g\",DATUM[\"d\",SPHEROID[\"s\",6378137,298.257223563]]]";
+    for (int i = 0; i < 400; ++i) {
+        wkt += ",PARAMETER[\"p" + std::to_string(i) + "\"," + std::to_string(i) + ".25]";
+    }
+    wkt += "]";
+    auto doc = WKTDocument::parse(wkt);
+
+    for (int indent : {-1, 0, 2}) {
+        SerializeOptions options;
+        options.indent = indent;
+        const std::string expected = doc.root()->toString(indent);
+        assert(expected.size() > 8192);
+        assert(doc.serializedSize(options) == expected.size());
+        
+        // sized up front or grown, the text is the same
+        options.exactSize = true;
+        assert(doc.toString(options) == expected);
+        options.exactSize = false;
+        assert(doc.toString(options) == expected);
+
+        // a reused string keeps its storage
+        std::string buffer;
+        buffer.reserve(expected.size());
+        const char* storage = buffer.data();
+        for (int pass = 0; pass < 2; ++pass) {
+            buffer.clear();
+            StringSink sink(buffer);
+            doc.serialize(sink, options);
+            assert(buffer == expected);
+            assert(buffer.data() == storage);
+        }
+
+        std::string collected;
+        size_t pieces = 0;
+        CallbackSink callback([&](std::string_view piece) {
+            collected.append(piece);
+            ++pieces;
+        });
+        doc.serialize(callback, options);
+        assert(collected == expected);
+        assert(pieces < expected.size() / 1024);
+
+        std::FILE* file = std::tmpfile();
+        assert(file);
+        FileSink fileSink(file);
+        doc.serialize(fileSink, options);
+        std::rewind(file);
+        std::string readBack(expected.size(), '\0');
+        assert(std::fread(&readBack[0], 1, readBack.size(), file) == readBack.size());
+        std::fclose(file);
+        assert(readBack == expected);
+    }
+
+    assert(doc.toString() == doc.root()->toString(-1));
+    assert(doc.toString(true) == doc.root()->toString(2));
+}
+
+TEST(serialization_number_format) {
+    // shortest round-trip: every double reads back bit for bit
+    const std::string wkt = "SPHEROID[\"s\",6378137.000,298.257223563,0.017453292519943295,1.0E-7,-0.1,1e300]";
+    auto doc = WKTDocument::parse(wkt);
+    assert(doc.toString() == "SPHEROID[\"s\",6378137,298.257223563,0.017453292519943295,1e-07,-0.1,1e+300]");
+
+    auto again = WKTDocument::parse(doc.toString());
+    assert(again.root()->numbers() == doc.root()->numbers());
+
+    // whole numbers stay positional where an exponent would be shorter
+    auto whole = WKTDocument::parse("PARAMETER[\"p\",500000.0,10000000,-3000,1e15,123456789012345,0.5e6]");
+    assert(whole.toString() == "PARAMETER[\"p\",500000,10000000,-3000,1e+15,123456789012345,500000]");
+    assert(WKTDocument::parse(whole.toString()).root()->numbers() == whole.root()->numbers());
+    
+    // negative zero is written as 0
+    auto zero = WKTDocument::parse("PRIMEM[\"Greenwich\",-0.0]");
+    assert(zero.toString() == "PRIMEM[\"Greenwich\",0]");
+    zero.setNumber("PRIMEM", 0, -0.0);
+    assert(zero.toString() == "PRIMEM[\"Greenwich\",0]");
+    assert(zero.serializedSize() == zero.toString().size());
+
+    // original lexemes: an untouched compact document comes back byte for byte
+    SerializeOptions original;
+    original.numbers = NumberFormat::Original;
+    assert(doc.toString(original) == wkt);
+    assert(doc.serializedSize(original) == wkt.size());
+
+    // a changed number is formatted, the rest keep their spelling
+    doc.setNumber("SPHEROID", 3, 2.5e-8);
+    doc.root()->addNumber(42);
+    assert(doc.toString(original) == "SPHEROID[\"s\",6378137.000,298.257223563,0.017453292519943295,2.5e-08,-0.1,1e300,42]");
+
+    // lexemes are relative to the node, so nested and streamed trees work too
+    const std::string nested = "GEOGCS[\"g\", DATUM[\"d\", SPHEROID[\"s\", 6378137.0, 298.2572235630]], UNIT[\"Degree\", 0.01745329251994330]]";
+    auto nestedDoc = WKTDocument::parse(nested);
+    assert(nestedDoc.toString(original) == "GEOGCS[\"g\",DATUM[\"d\",SPHEROID[\"s\",6378137.0,298.2572235630]],UNIT[\"Degree\",0.01745329251994330]]");
+
+    WKTStreamReader reader("UNIT[\"a\",1.00]\nUNIT[\"b\",2.50]\n");
+    StreamRecord record;
+    assert(reader.next(record) && reader.next(record));
+    assert(record.document->toString(original) == "UNIT[\"b\",2.50]");
+}
+
+TEST(serialization_patch) {
+    const std::string wkt =
+        "PROJCS[\"p\",\n"
+        "  GEOGCS[\"g\",\n"
+        "    DATUM[\"D_Old\", SPHEROID[\"s\",6378137.0,298.257223563]],\n"
+        "    UNIT[\"Degree\", 0.0174532925199433]],\n"
+        "  PARAMETER[\"False_Easting\", 500000.0]]\n";
+    auto doc = WKTDocument::parse(wkt);
+
+    // untouched: one piece, the source itself
+    assert(doc.root()->isClean());
+    PatchList same = doc.patch();
+    assert(same.pieces().size() == 1 && same.generatedSize() == 0);
+    assert(same.toString() == wkt);
+
+    // one edit: only the edited node is re-emitted
+    WKTNode* datum = doc.find("DATUM");
+    datum->setStringValue("D_New");
+    assert(datum->isModified() && !datum->parent()->isModified() && !doc.root()->isClean());
+    assert(doc.find("SPHEROID")->isClean() && doc.find("UNIT")->isClean());
+
+    PatchList patched = doc.patch();
+    std::string expected = wkt;
+    expected.replace(expected.find("DATUM"), std::string("DATUM[\"D_Old\", ").size(), "DATUM[\"D_New\",");
+    assert(patched.toString() == expected);
+    assert(patched.size() == expected.size());
+    assert(patched.generatedSize() == std::string("DATUM[\"D_New\",]").size());
+    assert(patched.pieces().size() == 5);   // prefix, DATUM head, SPHEROID, "]", rest
+
+    // a changed number and an added child
+    doc.setNumber("PARAMETER", 0, 400000);
+    doc.find("GEOGCS")->addChild(WKTNode::create("AUTHORITY"));
+    auto reparsed = WKTDocument::parse(doc.patch().toString());
+    assert(utils::areEquivalent(reparsed, doc));
+    assert(reparsed.find("UNIT")->numbers()[0] == 0.0174532925199433);
+
+    // the gather list straight to a file descriptor
+    std::FILE* file = std::tmpfile();
+    assert(file);
+    PatchList list = doc.patch();
+    list.writeTo(fileno(file));
+    std::rewind(file);
+    std::string readBack(list.size(), '\0');
+    assert(std::fread(&readBack[0], 1, readBack.size(), file) == readBack.size());
+    std::fclose(file);
+    assert(readBack == list.toString());
+
+    // built or copied nodes have no source text
+    NodePtr built = WKTNode::create("UNIT");
+    assert(built->isModified() && doc.root()->clone(doc.resource())->isModified());
+    
+    // a section copied from another document is formatted, not read from
+    // this document's source at the other one's offsets
+    auto from = WKTDocument::parse("UNIT[\"Meter\",1.000]");
+    auto into = WKTDocument::parse("GEOGCS[\"abcdefghijklmnopqrstuvwxyz\"]");
+    into.root()->addChild(from.root()->clone(from.resource()));
+    SerializeOptions original;
+    original.numbers = NumberFormat::Original;
+    assert(into.toString(original) == "GEOGCS[\"abcdefghijklmnopqrstuvwxyz\",UNIT[\"Meter\",1]]");
+    assert(into.patch().toString() == into.toString());
+}
+
+// ============================================================================
+// file tests
+// ============================================================================
+
+TEST(file_parse_mapped_and_read) {
+    const std::string wkt = "GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\"],UNIT[\"Degree\",0.017453292519943295]]";
+    // trailing whitespace pushes the large file past the mmap threshold
+    const std::string small = wkt;
+    const std::string large = wkt + std::string(64 * 1024, ' ');
+    
+    const std::string smallPath = "wkt_file_small.prj";
+    const std::string largePath = "wkt_file_large.prj";
+    for (auto [path, content] : {std::pair{smallPath, small}, std::pair{largePath, large}}) {
+        if (std::FILE* file = std::fopen(path.c_str(), "wb")) {
+            std::fwrite(content.data(), 1, content.size(), file);
+            std::fclose(file);
+        }
+    }
+    
+    auto smallDoc = WKTDocument::parseFile(smallPath);
+    auto largeDoc = WKTDocument::parseFile(largePath);
+    std::remove(smallPath.c_str());
+    std::remove(largePath.c_str());
+    
+    assert(smallDoc.originalSource() == small);
+    assert(largeDoc.originalSource() == large);
+    assert(largeDoc.getDatumName() == "D_WGS_1984");
+    
+    // the mapping travels with the document
+    WKTDocument moved = std::move(largeDoc);
+    assert(moved.originalSource() == large);
+    assert(moved.find("UNIT")->numbers()[0] == 0.017453292519943295);
+    
+    std::string error;
+    assert(!WKTDocument::tryParseFile("does/not/exist.prj", &error).has_value());
+    assert(error.find("does/not/exist.prj") != std::string::npos);
+    
+    bool threw = false;
+    try {
+        WKTDocument::parseFile("does/not/exist.prj");
+    } catch (const std::system_error&) {
+        threw = true;
+    }
+    assert(threw);
+}
+
+// ============================================================================
+// stream tests
+// ============================================================================
+
+TEST(stream_records_and_errors) {
+    const std::string input =
+        "GEOGCS[\"A\",UNIT[\"Degree\",0.0174532925199433]]\n"
+        "GEOGCS[\"B\",DATUM[\"D_B\"]] GEOGCS[\"C\"]\n"    // two records on one line
+        "GEOGCS[\"Bad\",@]\n"
+        "GEOGCS[\"Open\",DATUM[\"D_Open\"]\n"            // missing ']' swallows the next line
+        "PROJCS[\"D\",GEOGCS[\"E\"]]\n";
+    
+    WKTStreamReader reader(input);
+    std::vector<StreamRecord> records;
+    for (StreamRecord record; reader.next(record); ) {
+        records.push_back(std::move(record));
+    }
+    assert(records.size() == 6);
+    
+    const char* names[] = {"A", "B", "C", nullptr, nullptr, "D"};
+    for (size_t i = 0; i < records.size(); ++i) {
+        const StreamRecord& r = records[i];
+        assert(input.compare(r.offset, r.text.size(), r.text) == 0);
+        if (names[i]) {
+            assert(r.ok());
+            assert(*r.document->root()->stringValue() == names[i]);
+            // each document owns just its record; ranges are record-relative
+            assert(r.document->originalSource() == r.text);
+            assert(r.document->root()->sourceStart() == 0);
+            assert(r.document->root()->sourceEnd() == r.text.size());
+        } else {
+            assert(!r.ok() && !r.document);
+            assert(r.errorOffset >= r.offset);
+        }
+    }
+    assert(records[1].offset == input.find("GEOGCS[\"B\""));
+    assert(records[2].text == "GEOGCS[\"C\"]");
+    assert(records[3].text.substr(0, 12) == "GEOGCS[\"Bad\"");
+    assert(records[3].errorOffset == input.find('@') + 1);
+    assert(records[3].error.find("line 3") != std::string::npos);
+    assert(records[4].offset == input.find("GEOGCS[\"Open\""));
+    assert(records[5].document->find("GEOGCS")->stringValue() == "E");
+    
+    // spans only: same framing, no trees
+    WKTStreamReader spans(input);
+    size_t count = 0;
+    for (StreamRecord record; spans.nextSpan(record); ++count) {
+        assert(record.offset == records[count].offset && record.text == records[count].text);
+        assert(!record.document);
+    }
+    assert(count == records.size());
+    
+    // a bad token opening the line after a complete record fails only that line
+    const std::string after = "A[1]\n@bad\nB[2]\n";
+    for (bool spanOnly : {false, true}) {
+        WKTStreamReader lookahead(after);
+        std::vector<StreamRecord> got;
+        for (StreamRecord record; spanOnly ? lookahead.nextSpan(record) : lookahead.next(record); ) {
+            got.push_back(std::move(record));
+        }
+        assert(got.size() == 3);
+        assert(got[0].ok() && got[0].text == "A[1]" && got[0].offset == 0);
+        assert(!got[1].ok() && got[1].offset == after.find('@'));
+        assert(got[1].text == "@bad\n");
+        assert(got[1].error.find("line 2") != std::string::npos);
+        assert(got[2].ok() && got[2].text == "B[2]");
+        if (!spanOnly) {
+            assert(got[0].document->root()->numbers()[0] == 1.0);
+        }
+    }
+}
+
+TEST(stream_parallel_chunks) {
+    std::string input;
+    for (int i = 0; i < 500; ++i) {
+        input += "GEOGCS[\"GCS_" + std::to_string(i) + "\",\n  DATUM[\"D\",SPHEROID[\"S\",6378137.0,298.257223563]],\n  UNIT[\"Degree\"," + std::to_string(i) + "]]\n";
+        if (i % 97 == 5) input += "GEOGCS[\"broken\",@]\n";
+    }
+    
+    std::vector<size_t> sequential;
+    WKTStreamReader reader(input);
+    for (StreamRecord record; reader.next(record); ) {
+        sequential.push_back(record.offset);
+    }
+    assert(sequential.size() == 506);
+    
+    // chunks start at records, so their readers see the same records
+    auto chunks = WKTStreamReader::split(input, 7);
+    assert(chunks.size() == 7);
+    std::vector<std::vector<size_t>> perChunk(chunks.size());
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        assert(chunks[c].text.data() == input.data() + chunks[c].offset);
+        threads.emplace_back([&, c] {
+            WKTStreamReader chunkReader(chunks[c]);
+            for (StreamRecord record; chunkReader.next(record); ) {
+                perChunk[c].push_back(record.offset);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    
+    std::vector<size_t> joined;
+    for (auto& offsets : perChunk) joined.insert(joined.end(), offsets.begin(), offsets.end());
+    assert(joined == sequential);
+    
+    // the same through the batch pool
+    BatchParser batch(3);
+    std::atomic<int> good{0}, bad{0};
+    batch.parseStream(input, [&](StreamRecord&& record) { (record.ok() ? good : bad)++; });
+    assert(good == 500 && bad == 6);
+}
+
+TEST(stream_split_quoted_boundary) {
+    // a quoted value holding "]\n<NAME>" looks like a record boundary
+    std::string input;
+    for (int i = 0; i < 40; ++i) {
+        input += "GEOGCS[\"rec" + std::to_string(i) + "]\nDATUM[x\",UNIT[\"D\",1]]\n";
+    }
+    
+    std::vector<size_t> sequential;
+    WKTStreamReader reader(input);
+    for (StreamRecord record; reader.next(record); ) {
+        assert(record.ok());
+        sequential.push_back(record.offset);
+    }
+    assert(sequential.size() == 40);
+    
+    auto chunks = WKTStreamReader::split(input, 8);
+    std::vector<size_t> joined;
+    for (const auto& chunk : chunks) {
+        assert(input.compare(chunk.offset, 7, "GEOGCS[") == 0);
+        WKTStreamReader chunkReader(chunk);
+        for (StreamRecord record; chunkReader.next(record); ) {
+            assert(record.ok());
+            joined.push_back(record.offset);
+        }
+    }
+    assert(joined == sequential);
+    
+    BatchParser batch(4);
+    std::atomic<int> good{0}, bad{0};
+    batch.parseStream(input, [&](StreamRecord&& record) { (record.ok() ? good : bad)++; });
+    assert(good == 40 && bad == 0);
+}
+
+// ============================================================================
+// batch tests
+// ============================================================================
+
+TEST(batch_buffers_in_order) {
+    std::vector<std::string> inputs;
+    for (int i = 0; i < 500; ++i) {
+        if (i % 50 == 7) {
+            inputs.push_back("GEOGCS[\"broken\"");
+        } else {
+            inputs.push_back("GEOGCS[\"GCS_" + std::to_string(i) + "\",UNIT[\"Degree\"," + std::to_string(i) + "]]");
+        }
+    }
+    std::vector<std::string_view> views(inputs.begin(), inputs.end());
+    
+    BatchParser batch(4);
+    assert(batch.threadCount() == 4);
+    
+    auto results = batch.parseBuffers(views);
+    assert(results.size() == inputs.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (i % 50 == 7) {
+            assert(!results[i].ok() && !results[i].error.empty());
+        } else {
+            assert(results[i].ok());
+            const std::string expected = "GCS_" + std::to_string(i);
+            assert(*results[i].document->root()->stringValue() == std::string_view(expected));
+            assert(results[i].document->find("UNIT")->numbers()[0] == double(i));
+        }
+    }
+    
+    // streaming: every index delivered exactly once
+    std::vector<std::atomic<int>> seen(views.size());
+    batch.parseBuffers(views, [&](size_t index, BatchResult&&) { seen[index]++; });
+    for (auto& count : seen) assert(count == 1);
+    
+    // callback exceptions reach the caller
+    bool threw = false;
+    try {
+        batch.parseBuffers(views, [](size_t index, BatchResult&&) {
+            if (index == 123) throw std::runtime_error("stop");
+        });
+    } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+}
+
+TEST(batch_files) {
+    const std::string path = "wkt_batch_test.prj";
+    if (std::FILE* file = std::fopen(path.c_str(), "wb")) {
+        std::fputs("GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\"]]", file);
+        std::fclose(file);
+    }
+    
+    BatchParser batch(2);
+    auto results = batch.parseFiles({path, "does/not/exist.prj", path});
+    std::remove(path.c_str());
+    
+    assert(results[0].ok() && results[0].document->getDatumName() == "D_WGS_1984");
+    assert(!results[1].ok() && results[1].error.find("does/not/exist.prj") != std::string::npos);
+    assert(results[2].ok());
+}
+
+// ============================================================================
+// cache tests
+// ============================================================================
+
+TEST(cache_shares_and_evicts) {
+    ParseCacheOptions options;
+    options.maxEntries = 4;
+    options.shards = 1;
+    ParseCache cache(options);
+    
+    const std::string wgs84 = "GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\"]]";
+    std::string error;
+    auto first = cache.tryParse(wgs84, &error);
+    auto again = cache.tryParse(std::string(wgs84), &error);   // same bytes, other buffer
+    assert(first && first == again);
+    assert(first->getDatumName() == "D_WGS_1984");
+    assert(cache.parse(wgs84 + " ") != first);
+    
+    // failures are reported as by WKTDocument::tryParse, and not cached
+    assert(!cache.tryParse("GEOGCS[\"broken\"", &error) && !error.empty());
+    bool threw = false;
+    try { cache.parse("GEOGCS[\"broken\""); } catch (const ParseError&) { threw = true; }
+    assert(threw);
+    
+    ParseCacheStats stats = cache.stats();
+    assert(stats.hits == 1 && stats.misses == 4 && stats.entries == 2 && stats.evictions == 0);
+    assert(stats.bytes == 2 * wgs84.size() + 1);
+    
+    // CLOCK: entries hit since the hand last passed survive a full cache
+    for (int i = 0; i < 10; ++i) {
+        cache.tryParse(wgs84);
+        cache.parse("GEOGCS[\"GCS_" + std::to_string(i) + "\"]");
+    }
+    stats = cache.stats();
+    assert(stats.entries == 4 && stats.evictions == 8);
+    assert(cache.tryParse(wgs84) == first);
+    
+    // documents handed out outlive eviction
+    cache.clear();
+    assert(cache.stats().entries == 0 && cache.stats().bytes == 0);
+    assert(first->root()->name() == "GEOGCS");
+    
+    // byte budget; a document over it is returned, not cached
+    options.maxEntries = 0;
+    options.maxBytes = 100;
+    ParseCache small(options);
+    for (int i = 0; i < 10; ++i) {
+        small.parse("GEOGCS[\"GCS_" + std::to_string(i) + "\"]");   // 15 bytes each
+    }
+    assert(small.stats().entries == 6 && small.stats().bytes == 90);
+    const std::string large = "GEOGCS[\"" + std::string(200, 'x') + "\"]";
+    assert(small.parse(large) && small.stats().entries == 6);
+    
+    // shard shares add up to the limit when it does not divide evenly:
+    // 3 entries over 2 shards, 5 over 4
+    for (size_t maxEntries : {3, 5}) {
+        ParseCacheOptions uneven;
+        uneven.maxEntries = maxEntries;
+        uneven.shards = 4;
+        ParseCache cache(uneven);
+        for (int i = 0; i < 200; ++i) {
+            cache.parse("GEOGCS[\"GCS_" + std::to_string(i) + "\"]");
+        }
+        assert(cache.stats().entries == maxEntries);
+    }
+}
+
+TEST(cache_concurrent_readers) {
+    std::vector<std::string> inputs;
+    for (int i = 0; i < 12; ++i) {
+        inputs.push_back("PROJCS[\"UTM_" + std::to_string(i) + "\",GEOGCS[\"GCS_WGS_1984\"],"
+                         "PARAMETER[\"Central_Meridian\"," + std::to_string(6 * i - 177) + "]]");
+    }
+    
+    ParseCache cache;
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong{0};
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 3000; ++i) {
+                const size_t which = size_t(i * 7 + t) % inputs.size();
+                auto doc = cache.tryParse(inputs[which]);
+                if (!doc || doc->getParameter(ProjectionParameter::CentralMeridian) != double(6 * int(which) - 177)) {
+                    wrong++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    assert(wrong == 0);
+    
+    // a racing miss may parse twice, but only one document is kept per input
+    const ParseCacheStats stats = cache.stats();
+    assert(stats.entries == inputs.size());
+    assert(stats.hits + stats.misses == 8 * 3000 && stats.misses >= inputs.size());
+    for (const auto& input : inputs) {
+        assert(cache.tryParse(input) == cache.tryParse(input));
+    }
+}
+
+// ============================================================================
+// instrumentation tests
+// ============================================================================
+
+TEST(instrument_counters) {
+    using instrument::Phase;
+    const std::string wkt = "GEOGCS[\"WGS 84\",DATUM[\"WGS_1984\",SPHEROID[\"WGS 84\",6378137,298.257223563]]]";
+    
+    instrument::reset();
+    Lexer lexer(wkt);
+    const size_t tokenCount = lexer.tokenize().size();
+    auto doc = WKTDocument::parse(wkt);
+    const std::string text = doc.root()->toString();
+    assert(!WKTDocument::tryParse("GEOGCS[\"broken\""));
+    const instrument::Snapshot stats = instrument::snapshot();
+    
+    if (!instrument::kEnabled) {
+        for (const auto& phase : stats.phases) {
+            assert(phase.calls == 0 && phase.nanoseconds == 0 && phase.bytes == 0);
+        }
+        return;
+    }
+    
+    assert(stats[Phase::Lex].calls == 1);
+    assert(stats[Phase::Lex].tokens == tokenCount);
+    assert(stats[Phase::Lex].numbers == 2);
+    assert(stats[Phase::Lex].bytes == wkt.size());
+    
+    // the document's parse and the failed one; nested phases count in both
+    assert(stats[Phase::Document].calls == 2);
+    assert(stats[Phase::Document].exceptions == 1);
+    assert(stats[Phase::Document].nodes >= 3);
+    assert(stats[Phase::Document].allocations >= 1);
+    assert(stats[Phase::Parse].calls == 2 && stats[Phase::Parse].exceptions == 1);
+    assert(stats[Phase::Parse].nodes == stats[Phase::Document].nodes);
+    assert(stats[Phase::Parse].bytes >= wkt.size());
+    
+    assert(stats[Phase::Serialize].calls >= 1);
+    assert(stats[Phase::Serialize].bytes >= text.size());
+    
+    // reset() moves the baseline
+    instrument::reset();
+    assert(instrument::snapshot()[Phase::Document].calls == 0);
+    
+    // other threads' phases are summed in, also after they exit
+    std::thread([&] { WKTDocument::parse(wkt); }).join();
+    assert(instrument::snapshot()[Phase::Document].calls == 1);
+}
+
 // ============================================================================
 // utility tests
 // ============================================================================
@@ -391,6 +1576,79 @@ TEST(utils_validate) {
     assert(!utils::validateWKT(""));
 }
 
+TEST(utils_structural_hash) {
+    const std::string wkt =
+        "PROJCS[\"UTM\",GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\",SPHEROID[\"WGS_1984\",6378137.0,298.257223563]],"
+        "UNIT[\"Degree\",0.0174532925199433]],PARAMETER[\"Central_Meridian\",9.0],UNIT[\"Meter\",1.0]]";
+    auto doc = WKTDocument::parse(wkt);
+    const WKTNode* root = doc.root();
+    
+    // same content, same hash: layout and number spelling do not count,
+    // nor does where a subtree sits
+    auto spaced = WKTDocument::parse(
+        "PROJCS[\"UTM\",\n  GEOGCS[\"GCS_WGS_1984\", DATUM[\"D_WGS_1984\", SPHEROID[\"WGS_1984\", 6378137, 298.257223563]],\n"
+        "  UNIT[\"Degree\", 0.0174532925199433]], PARAMETER[\"Central_Meridian\", 9e0], UNIT[\"Meter\", 1]]");
+    assert(spaced.root()->hash() == root->hash() && spaced.root()->shapeHash() == root->shapeHash());
+    auto geographic = WKTDocument::parse(
+        "GEOGCS[\"Other\",DATUM[\"D_WGS_1984\",SPHEROID[\"WGS_1984\",6378137.0,298.257223563]]]");
+    assert(geographic.find("DATUM")->hash() == doc.find("DATUM")->hash());
+    assert(geographic.root()->hash() != doc.find("GEOGCS")->hash());
+    assert(doc.find("GEOGCS/UNIT")->hash() != doc.find("UNIT")->hash());
+    
+    // edits rehash the path to the root; values only move the exact hash
+    const uint64_t before = root->hash();
+    const uint64_t shape = root->shapeHash();
+    const uint64_t geogcs = doc.find("GEOGCS")->hash();
+    doc.setNumber("PARAMETER", 0, 15.0);
+    assert(root->hash() != before && root->shapeHash() == shape && doc.find("GEOGCS")->hash() == geogcs);
+    doc.setNumber("PARAMETER", 0, 9.0);
+    assert(root->hash() == before);
+    doc.setNumber("SPHEROID", 0, -0.0);
+    const uint64_t negativeZero = root->hash();
+    doc.setNumber("SPHEROID", 0, 0.0);
+    assert(root->hash() == negativeZero);
+    doc.setNumber("SPHEROID", 0, 6378137.0);
+    doc.setValue("DATUM", "D_Other");
+    assert(root->shapeHash() != shape && doc.find("GEOGCS")->hash() != geogcs);
+    doc.setValue("DATUM", "D_WGS_1984");
+    assert(root->hash() == before && root->clone(doc.resource())->hash() == before);
+    
+    // lazily parsed and incrementally re-parsed trees hash the same
+    ParseOptions lazy;
+    lazy.lazy = true;
+    assert(WKTDocument::parse(wkt, lazy).root()->hash() == before);
+    auto edited = WKTDocument::parse(wkt);
+    edited.root()->hash();
+    edited.applyEdit(TextEdit{wkt.find("9.0"), wkt.find("9.0") + 3, "15.0"});
+    std::string changed = wkt;
+    changed.replace(wkt.find("9.0"), 3, "15.0");
+    assert(edited.root()->hash() == WKTDocument::parse(changed).root()->hash());
+    
+    // bucketed: near-identical values meet, distinct ones do not
+    auto near = WKTDocument::parse(std::string(wkt).replace(wkt.find("6378137.0"), 9, "6378137.0000001"));
+    assert(near.root()->hash() != before && near.root()->shapeHash() == shape);
+    assert(near.root()->hash(1e-3) == root->hash(1e-3) && root->hash(0.0) == before);
+    assert(edited.root()->hash(1e-3) != root->hash(1e-3));
+    
+    // areEquivalent: the hashes only ever rule pairs out
+    assert(utils::areEquivalent(doc, spaced) && utils::areEquivalent(doc, spaced, 0.0));
+    assert(utils::areEquivalent(doc, near, 1e-6) && !utils::areEquivalent(doc, near, 0.0));
+    assert(!utils::areEquivalent(doc, near, 1e-10) && !utils::areEquivalent(doc, edited, 1.0));
+    assert(!utils::areEquivalent(doc, geographic));
+    
+    // deduplicating a corpus: bucket by hash, confirm within buckets
+    std::vector<WKTDocument> corpus;
+    for (const WKTDocument* d : {&doc, &spaced, &geographic, &near, &edited}) {
+        corpus.push_back(WKTDocument::parse(d->toString()));
+    }
+    std::unordered_map<uint64_t, std::vector<size_t>> buckets;
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        buckets[corpus[i].root()->hash()].push_back(i);
+    }
+    assert(buckets.size() == 4 && buckets[before].size() == 2);
+    assert(utils::areEquivalent(corpus[buckets[before][0]], corpus[buckets[before][1]], 0.0));
+}
+
 TEST(utils_guess_epsg) {
     auto doc = WKTDocument::parse("GEOGCS[\"test\",DATUM[\"D_WGS_1984\"]]");
     auto epsg = utils::guessEPSG(doc);
@@ -399,6 +1657,112 @@ TEST(utils_guess_epsg) {
     assert(*epsg == 4326);
 }
 
+TEST(utils_guess_epsg_projected) {
+    const std::string wgs84 =
+        "GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\",SPHEROID[\"WGS_1984\",6378137.0,298.257223563]],"
+        "PRIMEM[\"Greenwich\",0.0],UNIT[\"Degree\",0.0174532925199433]]";
+    const std::string pulkovo =
+        "GEOGCS[\"GCS_Pulkovo_1942\",DATUM[\"D_Pulkovo_1942\",SPHEROID[\"Krasovsky_1940\",6378245.0,298.3]],"
+        "PRIMEM[\"Greenwich\",0.0],UNIT[\"Degree\",0.0174532925199433]]";
+    auto projcs = [](const std::string& geogcs, const std::string& projection, const std::string& parameters,
+                     const std::string& unit = "UNIT[\"Meter\",1.0]") {
+        return "PROJCS[\"test\"," + geogcs + ",PROJECTION[\"" + projection + "\"]," + parameters + "," + unit + "]";
+    };
+    auto guess = [](const std::string& wkt) { return utils::guessEPSG(WKTDocument::parse(wkt)); };
+    
+    assert(guess(wgs84) == 4326);
+    assert(guess("GEOGCS[\"NAD83\",DATUM[\"North American Datum 1983\"]]") == 4269);
+    
+    const std::string utm33 =
+        "PARAMETER[\"False_Easting\",500000.0],PARAMETER[\"False_Northing\",0.0],"
+        "PARAMETER[\"Central_Meridian\",15.0],PARAMETER[\"Scale_Factor\",0.9996],"
+        "PARAMETER[\"Latitude_Of_Origin\",0.0]";
+    assert(guess(projcs(wgs84, "Transverse_Mercator", utm33)) == 32633);
+    
+    // OGC spellings, any order, defaults left out
+    assert(guess(projcs(wgs84, "Transverse_Mercator",
+                        "PARAMETER[\"scale_factor\",0.9996],PARAMETER[\"central_meridian\",-75],"
+                        "PARAMETER[\"false_northing\",10000000],PARAMETER[\"false_easting\",500000]")) == 32718);
+    
+    // Pulkovo 1942 Gauss-Kruger: zone-prefixed easting, and without
+    assert(guess(projcs(pulkovo, "Gauss_Kruger",
+                        "PARAMETER[\"False_Easting\",19500000.0],PARAMETER[\"False_Northing\",0.0],"
+                        "PARAMETER[\"Central_Meridian\",111.0],PARAMETER[\"Scale_Factor\",1.0],"
+                        "PARAMETER[\"Latitude_Of_Origin\",0.0]")) == 28419);
+    assert(guess(projcs(pulkovo, "Transverse_Mercator",
+                        "PARAMETER[\"False_Easting\",500000.0],PARAMETER[\"Central_Meridian\",111.0],"
+                        "PARAMETER[\"Scale_Factor\",1.0]")) == 28479);
+    
+    // a kilometre grid is another CRS, though its origin is the same
+    assert(guess(projcs(wgs84, "Transverse_Mercator",
+                        "PARAMETER[\"False_Easting\",500],PARAMETER[\"Central_Meridian\",15.0],"
+                        "PARAMETER[\"Scale_Factor\",0.9996]", "UNIT[\"Kilometre\",1000]")) == std::nullopt);
+    
+    // no code: another projection, a zone the table does not have
+    assert(!guess(projcs(wgs84, "Mercator", utm33)));
+    assert(!guess(projcs(wgs84, "Transverse_Mercator",
+                         "PARAMETER[\"False_Easting\",500000.0],PARAMETER[\"Central_Meridian\",16.0],"
+                         "PARAMETER[\"Scale_Factor\",0.9996]")));
+    
+    // no exact code, only the nearest one: a stray parameter, a spheroid
+    // that is not quite the datum's
+    double confidence = 0;
+    assert(utils::guessEPSG(WKTDocument::parse(projcs(wgs84, "Transverse_Mercator", utm33)), &confidence) == 32633);
+    assert(confidence == 1.0);
+    auto stray = WKTDocument::parse(projcs(wgs84, "Transverse_Mercator", utm33 + ",PARAMETER[\"Auxiliary_Sphere_Type\",0.0]"));
+    assert(utils::guessEPSG(stray, &confidence) == 32633 && confidence < 1.0);
+    std::string wrongSpheroid = wgs84;
+    wrongSpheroid.replace(wrongSpheroid.find("298.257223563"), 13, "298.257222101");
+    assert(utils::guessEPSG(WKTDocument::parse(projcs(wrongSpheroid, "Transverse_Mercator", utm33)), &confidence) == 32633);
+    assert(confidence < 1.0);
+    
+    // a PROJCS no longer reports its datum's geographic code
+    assert(!guess("PROJCS[\"x\"," + pulkovo + "]"));
+}
+
+TEST(utils_match_epsg) {
+    auto utm = [](const std::string& datum, const std::string& spheroid, double centralMeridian) {
+        return "PROJCS[\"x\",GEOGCS[\"x\",DATUM[\"" + datum + "\",SPHEROID[\"x\"," + spheroid + "]],"
+               "UNIT[\"Degree\",0.0174532925199433]],PROJECTION[\"Transverse_Mercator\"],"
+               "PARAMETER[\"False_Easting\",500000.0],PARAMETER[\"Central_Meridian\"," +
+               std::to_string(centralMeridian) + "],PARAMETER[\"Scale_Factor\",0.9996],UNIT[\"Meter\",1.0]]";
+    };
+    
+    // truncated inverse flattening and float noise: the exact lookup
+    // misses, the nearest neighbour does not
+    auto noisy = WKTDocument::parse(utm("D_WGS_1984", "6378137.0,298.257224", 14.999999));
+    auto matches = utils::matchEPSG(noisy);
+    assert(matches.size() == 1 && matches[0].code == 32633);
+    assert(matches[0].distance > 0 && matches[0].distance <= 1);
+    assert(matches[0].confidence > 0.5 && matches[0].confidence < 1);
+    double confidence = 0;
+    assert(utils::guessEPSG(noisy, &confidence) == 32633 && confidence == matches[0].confidence);
+    
+    // tolerances bound the search
+    EpsgTolerance tight;
+    tight.inverseFlattening = 1e-7;
+    assert(utils::matchEPSG(noisy, tight).empty());
+    
+    // an unknown datum name: every datum whose spheroid fits is a
+    // candidate, ranked by distance; WGS 84 beats ETRS89's GRS 80
+    auto unnamed = WKTDocument::parse(utm("Local", "6378137.0,298.257223563", 15));
+    matches = utils::matchEPSG(unnamed);
+    assert(matches.size() == 2 && matches[0].code == 32633 && matches[1].code == 25833);
+    assert(matches[0].distance < 1e-6 && matches[0].confidence < 1 && matches[1].distance > 0.01);
+    assert(utils::matchEPSG(unnamed, {}, 1).size() == 1);
+    
+    // candidates nothing tells apart share the confidence
+    auto grs80 = WKTDocument::parse("GEOGCS[\"x\",DATUM[\"x\",SPHEROID[\"GRS_1980\",6378137.0,298.257222101]]]");
+    matches = utils::matchEPSG(grs80);
+    assert(matches.size() == 4);   // 4269, 4258, 4283 at distance 0, then 4326
+    assert(matches[0].confidence == matches[2].confidence && matches[3].code == 4326);
+    assert(std::abs(matches[0].confidence * 3 - 0.8) < 1e-12);   // inferred datum, three ways
+    
+    // nothing near: another datum's zone, or no spheroid to go by
+    assert(utils::matchEPSG(WKTDocument::parse(utm("D_Pulkovo_1942", "6378245.0,298.3", 15))).empty());
+    assert(utils::matchEPSG(WKTDocument::parse("GEOGCS[\"x\",DATUM[\"x\"]]")).empty());
+}
+
 // ============================================================================
 // edge cases
 // ============================================================================
@@ -438,6 +1802,210 @@ TEST(edge_multiple_empty_values) {
     // should parse without crashing
 }
 
+// ============================================================================
+// scaling tests
+// ============================================================================
+
+// Far deeper than any call stack would allow recursion to go
+TEST(scaling_deep_nesting) {
+    const size_t depth = 100000;
+    std::string wkt;
+    wkt.reserve(depth * 5);
+    for (size_t i = 0; i < depth; ++i) wkt += "A[";
+    wkt += "LEAF[\"x\",1.50]";
+    wkt.append(depth, ']');
+    
+    auto doc = WKTDocument::parse(wkt);
+    size_t levels = 0;
+    const WKTNode* node = doc.root();
+    while (!node->children().empty()) {
+        node = node->children()[0].get();
+        levels++;
+    }
+    assert(levels == depth && node->name() == "LEAF");
+    
+    // deep search, including the fallback that tries each child in turn
+    assert(doc.root()->findByPath("LEAF") == node);
+    assert(doc.root()->findByPath("A/LEAF") == node);
+    assert(doc.root()->findByPath("LEAF/A") == nullptr);   // tried under every level
+    
+    size_t visited = 0;
+    doc.root()->visit([&](WKTNode&) { visited++; });
+    assert(visited == depth + 1);
+    
+    assert(doc.root()->toString() == std::string(wkt).replace(wkt.find("1.50"), 4, "1.5"));
+    assert(doc.root()->serializedSize() == wkt.size() - 1);
+    
+    // copies, hashes and equivalence walk the whole depth too
+    WKTDocument copy = WKTDocument::parse(wkt);
+    assert(utils::areEquivalent(doc, copy));
+    assert(doc.root()->hash(0.01) == copy.root()->hash(0.01));
+    NodePtr cloned = doc.root()->clone(std::pmr::get_default_resource());
+    assert(cloned->hash() == doc.root()->hash());
+    
+    // an edit at the bottom rehashes and patches along the full path
+    assert(copy.root()->findByPath("LEAF")->setNumber(0, 2.0));
+    assert(copy.root()->hash() != doc.root()->hash());
+    assert(!utils::areEquivalent(doc, copy));
+    assert(copy.patch().toString() == std::string(wkt).replace(wkt.find("1.50"), 4, "2"));
+    
+    auto flat = FlatTree::parse(wkt);
+    assert(flat.size() == depth + 1);
+    assert(flat.root().findByPath("LEAF").numbers()[0] == 1.5);
+    
+    // lazily: each level jumps to its child's recorded closing bracket, so
+    // expanding the whole depth does not rescan the text below every level
+    ParseOptions lazy;
+    lazy.lazy = true;
+    auto deferred = WKTDocument::parse(wkt, lazy);
+    const WKTNode* bottom = deferred.root();
+    while (!bottom->children().empty()) bottom = bottom->children()[0].get();
+    assert(bottom->name() == "LEAF" && bottom->numbers()[0] == 1.5);
+    assert(bottom->sourceStart() == wkt.find("LEAF"));
+    assert(utils::areEquivalent(deferred, doc));
+    
+    // validation runs the same iterative grammar without building nodes
+    assert(utils::validateWKT(wkt));
+    wkt.pop_back();
+    assert(!utils::validateWKT(wkt));
+}
+
+TEST(scaling_wide_siblings) {
+    const size_t width = 1000000;
+    std::string wkt = "ROOT[\"wide\"";
+    wkt.reserve(width * 8);
+    for (size_t i = 0; i < width; ++i) {
+        wkt += i % 2 ? ",B[1]" : ",A[\"a\"]";
+    }
+    wkt += ",LAST[7]]";
+    
+    auto doc = WKTDocument::parse(wkt);
+    assert(doc.root()->children().size() == width + 1);
+    
+    // a miss tries the whole path under each child once: linear, not quadratic
+    assert(doc.root()->findByPath("LAST")->numbers()[0] == 7);
+    assert(doc.root()->findByPath("B/LAST") == nullptr);
+    assert(doc.root()->findByPath("ROOT/LAST") == nullptr);
+    
+    size_t visited = 0;
+    doc.root()->visit([&](WKTNode&) { visited++; });
+    assert(visited == width + 2);
+    assert(doc.root()->toString() == wkt);
+    
+    auto flat = FlatTree::parse(wkt);
+    assert(flat.size() == width + 2);
+    assert(!flat.root().findByPath("ROOT/LAST"));
+}
+
+TEST(scaling_many_distinct_names) {
+    // names are kept per node: any number of distinct ones parse, and none
+    // outlives its document
+    const size_t count = 100000;
+    std::string wkt = "GEOGCS[\"x\"";
+    for (size_t i = 0; i < count; ++i) {
+        wkt += ",N" + std::to_string(i) + "[" + std::to_string(i) + "]";
+    }
+    wkt += ",datum[\"D_WGS_1984\"]]";
+    
+    auto doc = WKTDocument::tryParse(wkt);
+    assert(doc && doc->root()->children().size() == count + 1);
+    assert(doc->find("N77777")->numbers()[0] == 77777);
+    assert(doc->sections().all(names::key("N123")).size() == 1);
+    assert(!doc->find("DATUM"));
+    assert(doc->find("DATUM", NameMatch::IgnoreCase)->name() == "datum");
+    
+    auto flat = FlatTree::parse(wkt);
+    assert(flat.find("N99999").numbers()[0] == 99999);
+    assert(flat.find("Datum", NameMatch::IgnoreCase).name() == "datum");
+    
+    // a lowercase keyword spelling needs nothing beyond its own node
+    auto lower = WKTDocument::parse("geogcs[\"x\",datum[\"D\",spheroid[\"S\",6378137.0,298.257223563]]]");
+    assert(lower.find("datum/spheroid")->numbers()[0] == 6378137.0);
+    assert(lower.find("DATUM/SPHEROID", NameMatch::IgnoreCase)->name() == "spheroid");
+}
+
+TEST(scaling_section_index_many_names) {
+    // one group per distinct name, found by hash: building and updating the
+    // index stay linear however many names a document uses
+    const size_t count = 20000;
+    std::string wkt = "GEOGCS[\"x\",EXT[";
+    for (size_t i = 0; i < count; ++i) {
+        if (i) wkt += ",";
+        wkt += "N" + std::to_string(i) + "[" + std::to_string(i) + "]";
+    }
+    wkt += "],UNIT[\"Degree\",0.0174532925199433]]";
+    
+    auto doc = WKTDocument::parse(wkt);
+    for (size_t i = 0; i < count; i += 997) {
+        const std::string name = "N" + std::to_string(i);
+        assert(doc.sections().first(names::key(name)) == doc.find(name));
+    }
+    
+    // spans two children of EXT, so all of EXT is re-parsed and re-indexed
+    const size_t start = wkt.find("N0[0]");
+    const WKTNode* ext = doc.applyEdit({start, wkt.find(",N2["), "M[0],N1[1]"});
+    assert(ext && ext->name() == "EXT");
+    assert(!doc.sections().first(names::key("N0")));
+    assert(doc.sections().first(names::key("M"))->numbers()[0] == 0);
+    assert(doc.sections().all(names::key("N19999")).size() == 1);
+    assert(doc.sections().first(names::key("N19999")) == doc.find("N19999"));
+    assert(doc.sections().first(names::UNIT) == doc.find("UNIT"));
+    
+    // keyword sections first seen after more than 32767 other groups
+    std::string late = "PROJCS[\"x\"";
+    for (size_t i = 0; i < 33000; ++i) {
+        late += ",N" + std::to_string(i) + "[1]";
+    }
+    late += ",GEOGCS[\"g\",DATUM[\"D_WGS_1984\",SPHEROID[\"WGS_1984\",6378137.0,298.257223563]]],"
+            "PARAMETER[\"False_Easting\",500000.0]]";
+    auto wide = WKTDocument::parse(late);
+    assert(wide.getDatumName() == "D_WGS_1984");
+    assert(wide.sections().first(names::SPHEROID)->numbers()[0] == 6378137.0);
+    assert(wide.getParameter(ProjectionParameter::FalseEasting) == 500000.0);
+}
+
+TEST(scaling_edits_in_wide_document) {
+    // later siblings count from their parent's end once an edit passes
+    // them, so an edit touches only its path, not every following node
+    const size_t count = 50000;
+    std::string text = "PROJCS[\"p\"";
+    for (size_t i = 0; i < count; ++i) {
+        text += ",PARAMETER[\"P" + std::to_string(i) + "\"," + std::to_string(i) + "]";
+    }
+    text += ",UNIT[\"Meter\",1.0]]";
+    auto doc = WKTDocument::parse(text);
+    
+    auto edit = [&](size_t at, std::string_view insert) {
+        doc.applyEdit({at, at, insert});
+        text.insert(at, insert);
+    };
+    
+    // typing in one place, then jumping between the two ends
+    const size_t middle = text.find("\"P25000\",") + 9;
+    for (int i = 0; i < 1000; ++i) {
+        edit(middle, " ");
+    }
+    for (int i = 0; i < 20; ++i) {
+        edit(text.find("\"P1\",") + 5, " ");
+        edit(text.find("\"P49998\",") + 9, " ");
+    }
+    assert(doc.originalSource() == text);
+    assert(doc.find("UNIT")->sourceStart() == text.find("UNIT"));
+    assert(doc.sections().first(names::UNIT)->sourceEnd() == text.size() - 1);
+    const WKTNode* last = doc.root()->children()[count - 1].get();
+    assert(last->sourceStart() == text.find("PARAMETER[\"P49999\""));
+    assert(doc.getParameter("P25000") == 25000.0 && doc.getParameter("P49998") == 49998.0);
+    
+    SerializeOptions original;
+    original.numbers = NumberFormat::Original;
+    auto again = WKTDocument::parse(text);
+    assert(doc.toString(original) == again.toString(original));
+    
+    // a copy keeps the positions, wherever its original's pivots were
+    NodePtr copy = doc.root()->clone(doc.resource());
+    assert(copy->children()[count - 1]->sourceStart() == last->sourceStart());
+}
+
 // ============================================================================
 // main
 // ============================================================================
@@ -452,7 +2020,10 @@ int main()
     std::cout << "--- Lexer ---\n";
     RUN_TEST(lexer_simple);
     RUN_TEST(lexer_numbers);
+    RUN_TEST(lexer_number_values);
     RUN_TEST(lexer_whitespace);
+    RUN_TEST(lexer_zero_copy);
+    RUN_TEST(lexer_structural_index);
     
     // parser tests
     std::cout << "\n--- Parser ---\n";
@@ -461,6 +2032,9 @@ int main()
     RUN_TEST(parser_nested);
     RUN_TEST(parser_complex);
     RUN_TEST(parser_pulkovo);
+    RUN_TEST(parser_streaming);
+    RUN_TEST(parser_arena_allocation);
+    RUN_TEST(parser_lazy);
     
     // real-world samples
     std::cout << "\n--- Real-world Samples ---\n";
@@ -475,6 +2049,12 @@ int main()
     // navigation tests
     std::cout << "\n--- Navigation ---\n";
     RUN_TEST(navigation_find_by_path);
+    RUN_TEST(navigation_section_names);
+    RUN_TEST(navigation_compiled_path);
+    RUN_TEST(navigation_section_index);
+    RUN_TEST(navigation_parameters);
+    RUN_TEST(navigation_parameters_renamed);
+    RUN_TEST(navigation_flat_tree);
     
     // modification tests
     std::cout << "\n--- Modification ---\n";
@@ -482,16 +2062,47 @@ int main()
     RUN_TEST(modification_set_number);
     RUN_TEST(modification_set_numbers);
     RUN_TEST(modification_nested);
+    RUN_TEST(modification_apply_edit);
     
     // serialization tests
     std::cout << "\n--- Serialization ---\n";
     RUN_TEST(serialization_roundtrip);
     RUN_TEST(serialization_pretty);
+    RUN_TEST(serialization_sinks);
+    RUN_TEST(serialization_number_format);
+    RUN_TEST(serialization_patch);
+    
+    // file tests
+    std::cout << "\n--- Files ---\n";
+    RUN_TEST(file_parse_mapped_and_read);
+    
+    // stream tests
+    std::cout << "\n--- Streams ---\n";
+    RUN_TEST(stream_records_and_errors);
+    RUN_TEST(stream_parallel_chunks);
+    RUN_TEST(stream_split_quoted_boundary);
+    
+    // batch tests
+    std::cout << "\n--- Batch ---\n";
+    RUN_TEST(batch_buffers_in_order);
+    RUN_TEST(batch_files);
+    
+    // cache tests
+    std::cout << "\n--- Parse cache ---\n";
+    RUN_TEST(cache_shares_and_evicts);
+    RUN_TEST(cache_concurrent_readers);
+    
+    // instrumentation tests
+    std::cout << "\n--- Instrumentation ---\n";
+    RUN_TEST(instrument_counters);
     
     // utility tests
     std::cout << "\n--- Utilities ---\n";
     RUN_TEST(utils_validate);
     RUN_TEST(utils_guess_epsg);
+    RUN_TEST(utils_guess_epsg_projected);
+    RUN_TEST(utils_match_epsg);
+    RUN_TEST(utils_structural_hash);
     
     // edge cases
     std::cout << "\n--- Edge Cases ---\n";
@@ -500,6 +2111,14 @@ int main()
     RUN_TEST(edge_deeply_nested);
     RUN_TEST(edge_multiple_empty_values);
     
+    // scaling tests
+    std::cout << "\n--- Scaling ---\n";
+    RUN_TEST(scaling_deep_nesting);
+    RUN_TEST(scaling_wide_siblings);
+    RUN_TEST(scaling_many_distinct_names);
+    RUN_TEST(scaling_section_index_many_names);
+    RUN_TEST(scaling_edits_in_wide_document);
+    
     std::cout << "\n=== Summary ===\n";
     if (failures == 0) {
         std::cout << "All tests passed!\n";
@@ -0,0 +1,183 @@
+#include "wkt_parser.hpp"
+
+namespace wkt
+{
+
+namespace names
+{
+
+// ============================================================================
+// Keyword table - perfect hash built at compile time
+// ============================================================================
+
+namespace
+{
+
+// Spellings of the Keyword enumerators, in the same order
+constexpr std::string_view kKeywordText[] =
+{
+    "GEOGCS", "PROJCS", "GEOCCS", "VERTCS", "VERT_CS", "COMPD_CS", "LOCAL_CS", "FITTED_CS",
+    "DATUM", "VDATUM", "VERT_DATUM", "LOCAL_DATUM", "SPHEROID", "PRIMEM", "UNIT",
+    "PARAMETER", "PROJECTION", "TOWGS84", "AUTHORITY", "AXIS", "EXTENSION", "GEOGTRAN", "METHOD",
+    "GEODCRS", "GEOGCRS", "PROJCRS", "VERTCRS", "COMPOUNDCRS", "BASEGEOGCRS", "BASEGEODCRS",
+    "CONVERSION", "ELLIPSOID", "ANGLEUNIT", "LENGTHUNIT", "SCALEUNIT", "CS", "ORDER", "ID",
+    "USAGE", "SCOPE", "AREA", "BBOX", "REMARK", "ANCHOR",
+};
+
+static_assert(sizeof(kKeywordText) / sizeof(kKeywordText[0]) == KeywordCount,
+              "kKeywordText must list every Keyword");
+
+constexpr char upper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+// FNV-1a over the upper-cased bytes, so both match modes hash alike
+constexpr uint32_t hashName(std::string_view name, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (char c : name)
+    {
+        hash ^= static_cast<unsigned char>(upper(c));
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+constexpr size_t kSlots = 256;
+constexpr uint8_t kEmptySlot = 0xFF;
+
+struct PerfectHash
+{
+    uint32_t seed;
+    uint8_t slots[kSlots];
+};
+
+// Tries seeds until every keyword lands in its own slot
+constexpr PerfectHash buildPerfectHash()
+{
+    for (uint32_t seed = 1; seed < 10000; ++seed)
+    {
+        PerfectHash table{seed, {}};
+        for (uint8_t& slot : table.slots)
+        {
+            slot = kEmptySlot;
+        }
+
+        bool collision = false;
+        for (NameId id = 0; id < KeywordCount && !collision; ++id)
+        {
+            uint8_t& slot = table.slots[hashName(kKeywordText[id], seed) % kSlots];
+            collision = slot != kEmptySlot;
+            slot = static_cast<uint8_t>(id);
+        }
+
+        if (!collision)
+        {
+            return table;
+        }
+    }
+    return PerfectHash{0, {}};
+}
+
+constexpr PerfectHash kPerfectHash = buildPerfectHash();
+static_assert(kPerfectHash.seed != 0, "no collision-free seed for the keyword table");
+
+std::optional<NameId> findKeyword(std::string_view name, NameMatch match)
+{
+    const uint8_t slot = kPerfectHash.slots[hashName(name, kPerfectHash.seed) % kSlots];
+    if (slot == kEmptySlot)
+    {
+        return std::nullopt;
+    }
+
+    const std::string_view keyword = kKeywordText[slot];
+    const bool same = (match == NameMatch::Exact) ? keyword == name : detail::equalsIgnoreCase(keyword, name);
+    return same ? std::optional<NameId>(slot) : std::nullopt;
+}
+
+// FNV-1a over the name as spelled, or upper-cased, tagged as hashed
+NameId hashedId(std::string_view name, bool fold)
+{
+    uint32_t hash = 2166136261u;
+    for (char c : name)
+    {
+        hash ^= static_cast<unsigned char>(fold ? upper(c) : c);
+        hash *= 16777619u;
+    }
+    return hash | kHashedBit;
+}
+
+} // namespace
+
+// ============================================================================
+// Public interface
+// ============================================================================
+
+SectionName key(std::string_view name)
+{
+    if (auto keyword = findKeyword(name, NameMatch::Exact))
+    {
+        return SectionName{*keyword, *keyword, kKeywordText[*keyword]};
+    }
+
+    // "Datum" folds to the DATUM keyword; other names to their hashed upper case
+    auto folded = findKeyword(name, NameMatch::IgnoreCase);
+    return SectionName{hashedId(name, false), folded ? *folded : hashedId(name, true), name};
+}
+
+SectionName key(NameId keyword)
+{
+    return SectionName{keyword, keyword, kKeywordText[keyword]};
+}
+
+std::optional<NameId> lookup(std::string_view name, NameMatch match)
+{
+    return findKeyword(name, match);
+}
+
+std::string_view text(NameId keyword)
+{
+    return kKeywordText[keyword];
+}
+
+bool resolvePath(std::string_view path, std::pmr::vector<SectionName>& names)
+{
+    while (!path.empty())
+    {
+        const size_t slashPos = path.find('/');
+        const std::string_view segment = path.substr(0, slashPos);
+        if (segment.empty())
+        {
+            return false;
+        }
+        names.push_back(key(segment));
+        path = (slashPos == std::string_view::npos) ? std::string_view{} : path.substr(slashPos + 1);
+    }
+    return true;
+}
+
+namespace detail
+{
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (upper(a[i]) != upper(b[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace detail
+
+} // namespace names
+
+} // namespace wkt
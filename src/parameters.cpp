@@ -0,0 +1,239 @@
+#include "wkt_parser.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace wkt
+{
+
+// ============================================================================
+// Parameter names
+// ============================================================================
+
+namespace
+{
+
+// Spellings in normalized form (see normalize)
+struct Alias
+{
+    std::string_view name;
+    ProjectionParameter key;
+};
+
+constexpr Alias kAliases[] =
+{
+    {"falseeasting",                   ProjectionParameter::FalseEasting},
+    {"eastingatfalseorigin",           ProjectionParameter::FalseEasting},
+    {"falsenorthing",                  ProjectionParameter::FalseNorthing},
+    {"northingatfalseorigin",          ProjectionParameter::FalseNorthing},
+    {"centralmeridian",                ProjectionParameter::CentralMeridian},
+    {"longitudeofnaturalorigin",       ProjectionParameter::CentralMeridian},
+    {"longitudeoforigin",              ProjectionParameter::CentralMeridian},
+    {"longitudeofcenter",              ProjectionParameter::CentralMeridian},
+    {"longitudeofcentre",              ProjectionParameter::CentralMeridian},
+    {"longitudeoffalseorigin",         ProjectionParameter::CentralMeridian},
+    {"latitudeoforigin",               ProjectionParameter::LatitudeOfOrigin},
+    {"latitudeofnaturalorigin",        ProjectionParameter::LatitudeOfOrigin},
+    {"latitudeofcenter",               ProjectionParameter::LatitudeOfOrigin},
+    {"latitudeofcentre",               ProjectionParameter::LatitudeOfOrigin},
+    {"latitudeoffalseorigin",          ProjectionParameter::LatitudeOfOrigin},
+    {"scalefactor",                    ProjectionParameter::ScaleFactor},
+    {"scalefactoratnaturalorigin",     ProjectionParameter::ScaleFactor},
+    {"scalefactoroninitialline",       ProjectionParameter::ScaleFactor},
+    {"standardparallel1",              ProjectionParameter::StandardParallel1},
+    {"latitudeof1ststandardparallel",  ProjectionParameter::StandardParallel1},
+    {"standardparallel2",              ProjectionParameter::StandardParallel2},
+    {"latitudeof2ndstandardparallel",  ProjectionParameter::StandardParallel2},
+    {"azimuth",                        ProjectionParameter::Azimuth},
+    {"azimuthofinitialline",           ProjectionParameter::Azimuth},
+};
+
+// Keeps ASCII letters (lower-cased) and digits, so "Standard_Parallel_1",
+// "standard parallel 1" and "StandardParallel1" compare equal
+class NormalizedName
+{
+public:
+    explicit NormalizedName(std::string_view name)
+    {
+        for (char c : name)
+        {
+            if (c >= 'A' && c <= 'Z')
+            {
+                push(static_cast<char>(c - 'A' + 'a'));
+            }
+            else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+            {
+                push(c);
+            }
+        }
+    }
+
+    std::string_view view() const
+    {
+        return overflow_.empty() ? std::string_view(buffer_, size_) : std::string_view(overflow_);
+    }
+
+private:
+    void push(char c)
+    {
+        if (overflow_.empty() && size_ < sizeof(buffer_))
+        {
+            buffer_[size_++] = c;
+            return;
+        }
+        // rare long names move to the heap
+        if (overflow_.empty())
+        {
+            overflow_.assign(buffer_, size_);
+        }
+        overflow_.push_back(c);
+    }
+
+    char buffer_[64];
+    size_t size_ = 0;
+    std::string overflow_;
+};
+
+ProjectionParameter keyOf(std::string_view normalized)
+{
+    for (const Alias& alias : kAliases)
+    {
+        if (alias.name == normalized)
+        {
+            return alias.key;
+        }
+    }
+    return ProjectionParameter::Unknown;
+}
+
+} // namespace
+
+ProjectionParameter projectionParameter(std::string_view name)
+{
+    return keyOf(NormalizedName(name).view());
+}
+
+// ============================================================================
+// ParameterMap
+// ============================================================================
+
+ParameterMap::ParameterMap(std::pmr::memory_resource* resource)
+    : entries_(resource)
+{
+    std::fill(std::begin(byKey_), std::end(byKey_), kNoEntry);
+}
+
+ParameterMap::ParameterMap(const WKTNode* projcs, std::pmr::memory_resource* resource)
+    : ParameterMap(resource)
+{
+    owner_ = projcs;
+    if (!projcs)
+    {
+        return;
+    }
+
+    for (const auto& child : projcs->children())
+    {
+        if (child->nameId() != names::PARAMETER || !child->stringValue())
+        {
+            continue;
+        }
+
+        const NormalizedName normalized(*child->stringValue());
+        const ProjectionParameter key = keyOf(normalized.view());
+        if (key != ProjectionParameter::Unknown && byKey_[size_t(key)] == kNoEntry)
+        {
+            byKey_[size_t(key)] = static_cast<uint32_t>(entries_.size());
+        }
+        entries_.push_back(Entry{std::pmr::string(normalized.view(), resource), key, child.get()});
+    }
+}
+
+const WKTNode* ParameterMap::find(ProjectionParameter key) const
+{
+    if (key == ProjectionParameter::Unknown)
+    {
+        return nullptr;
+    }
+    const uint32_t slot = byKey_[size_t(key)];
+    return slot == kNoEntry ? nullptr : entries_[size_t(slot)].node;
+}
+
+const WKTNode* ParameterMap::find(std::string_view name) const
+{
+    const NormalizedName normalized(name);
+    const ProjectionParameter key = keyOf(normalized.view());
+    if (key != ProjectionParameter::Unknown)
+    {
+        return find(key);
+    }
+
+    for (const Entry& entry : entries_)
+    {
+        if (entry.normalized == normalized.view())
+        {
+            return entry.node;
+        }
+    }
+    return nullptr;
+}
+
+namespace
+{
+
+std::optional<double> firstNumber(const WKTNode* node)
+{
+    if (!node || node->numbers().empty())
+    {
+        return std::nullopt;
+    }
+    return node->numbers()[0];
+}
+
+} // namespace
+
+std::optional<double> ParameterMap::get(ProjectionParameter key) const
+{
+    return firstNumber(find(key));
+}
+
+std::optional<double> ParameterMap::get(std::string_view name) const
+{
+    return firstNumber(find(name));
+}
+
+bool ParameterMap::replaceParameter(const WKTNode* removed, const WKTNode* inserted)
+{
+    auto listed = [](const WKTNode* node) { return node->nameId() == names::PARAMETER && node->stringValue(); };
+    if (!listed(removed) || !listed(inserted))
+    {
+        return !listed(removed) && !listed(inserted);
+    }
+
+    const NormalizedName normalized(*inserted->stringValue());
+    auto entry = std::lower_bound(entries_.begin(), entries_.end(), removed->sourceStart(),
+                                  [](const Entry& e, size_t offset) { return e.node->sourceStart() < offset; });
+    if (entry == entries_.end() || entry->node != removed || entry->normalized != normalized.view())
+    {
+        return false;
+    }
+    entry->node = inserted;
+    return true;
+}
+
+void ParameterMap::extract(std::vector<ParameterValue>& out) const
+{
+    out.clear();
+    out.reserve(entries_.size());
+    for (const Entry& entry : entries_)
+    {
+        const auto& numbers = entry.node->numbers();
+        out.push_back(ParameterValue
+        {
+            std::string_view(*entry.node->stringValue()),
+            entry.key,
+            numbers.empty() ? std::numeric_limits<double>::quiet_NaN() : numbers[0]
+        });
+    }
+}
+
+} // namespace wkt
@@ -1,6 +1,7 @@
 #include "wkt_parser.hpp"
 #include <sstream>
 #include <stdexcept>
+#include <utility>
 
 namespace wkt {
 
@@ -10,112 +11,369 @@ namespace wkt {
 
 ParseError::ParseError(const std::string& msg, const Token& token)
     : std::runtime_error(msg)
+    , lexeme_(token.value)
     , token_(token)
-{}
+{
+    token_.value = lexeme_;
+}
+
+ParseError::ParseError(const ParseError& other)
+    : std::runtime_error(other)
+    , lexeme_(other.lexeme_)
+    , token_(other.token_)
+{
+    token_.value = lexeme_;
+}
+
+ParseError& ParseError::operator=(const ParseError& other)
+{
+    std::runtime_error::operator=(other);
+    lexeme_ = other.lexeme_;
+    token_ = other.token_;
+    token_.value = lexeme_;
+    return *this;
+}
 
 // ============================================================================
 // Parser
 // ============================================================================
 
-Parser::Parser(std::vector<Token> tokens)
+Parser::Parser(std::vector<Token> tokens, std::pmr::memory_resource* resource)
     : tokens_(std::move(tokens))
-{}
+    , resource_(resource)
+{
+    current_ = pull();
+}
 
-std::unique_ptr<WKTNode> Parser::parse() 
+Parser::Parser(Lexer& lexer, std::pmr::memory_resource* resource)
+    : lexer_(&lexer)
+    , resource_(resource)
 {
-    if (isAtEnd()) 
+    current_ = pull();
+}
+
+// ============================================================================
+// Builders - turn the parser's node events into a concrete representation
+// ============================================================================
+
+namespace detail 
+{
+
+class TreeBuilder 
+{
+public:
+    // source ranges are stored relative to `base`; `index` sees every node;
+    // the stack of open nodes comes from `scratch`
+    TreeBuilder(std::pmr::memory_resource* resource, size_t base, SectionIndex* index,
+                std::pmr::memory_resource* scratch)
+        : resource_(resource)
+        , base_(base)
+        , index_(index)
+        , stack_(scratch)
+    {}
+    
+    void open(const Token& name) 
     {
-        error("Empty input");
+        stack_.push_back(WKTNode::create(name.value, resource_));
+        countNode();
+        stack_.back()->setSourceRange(name.position - base_, name.position - base_);
+        if (index_) 
+        {
+            index_->add(stack_.back().get(), stack_.size() - 1);
+        }
     }
     
-    auto node = parseNode();
+    void stringValue(const Token& token) 
+    {
+        stack_.back()->setStringValue(token.value);
+    }
     
-    if (!isAtEnd()) {
-        error("Unexpected token after end of WKT: " + peek().value);
+    void number(const Token& token, double value) 
+    {
+        WKTNode& node = *stack_.back();
+        const size_t offset = token.position - base_ - node.sourceStart();
+        if (offset <= UINT32_MAX && token.value.size() <= UINT32_MAX) 
+        {
+            node.addNumber(value, WKTNode::Lexeme{uint32_t(offset), uint32_t(token.value.size())});
+        }
+        else 
+        {
+            node.addNumber(value);
+        }
     }
     
-    return node;
-}
+    void close(size_t end) 
+    {
+        NodePtr node = std::move(stack_.back());
+        stack_.pop_back();
+        node->setSourceRange(node->sourceStart(), end - base_);
+        node->markParsed();   // its children are clean already
+        node->computeHash();   // ... and hashed
+        
+        if (stack_.empty()) 
+        {
+            root_ = std::move(node);
+        }
+        else 
+        {
+            stack_.back()->addChild(std::move(node));
+        }
+    }
+    
+    NodePtr take() { return std::move(root_); }
+    
+private:
+    std::pmr::memory_resource* resource_;
+    size_t base_;
+    SectionIndex* index_;
+    std::pmr::vector<NodePtr> stack_;
+    NodePtr root_;
+};
+
+} // namespace detail
 
-std::unique_ptr<WKTNode> Parser::parseNode()
+namespace 
 {
-    // expect: IDENTIFIER '[' content ']'
-    Token nameToken = consume(TokenType::Identifier, "Expected section name");
-    const size_t startPos = nameToken.position;
+
+// Checks the grammar only, remembering where the last node closed
+class SkipBuilder 
+{
+public:
+    void open(const Token&) {}
+    void stringValue(const Token&) {}
+    void number(const Token&, double) {}
+    void close(size_t end) { end_ = end; }
     
-    auto node = std::make_unique<WKTNode>(nameToken.value);
+    size_t end() const { return end_; }
     
-    consume(TokenType::LBracket, "Expected '[' after section name");
+private:
+    size_t end_ = 0;
+};
+
+} // namespace
+
+namespace detail 
+{
+
+class FlatTreeBuilder 
+{
+public:
+    explicit FlatTreeBuilder(FlatTree& tree)
+        : tree_(tree)
+    {}
+    
+    void open(const Token& name) 
+    {
+        const uint32_t index = static_cast<uint32_t>(tree_.nameIds_.size());
+        
+        const SectionName key = names::key(name.value);
+        tree_.nameIds_.push_back(key.id);
+        tree_.foldedIds_.push_back(key.folded);
+        tree_.nameLengths_.push_back(static_cast<uint32_t>(name.value.size()));
+        tree_.values_.emplace_back();
+        tree_.firstNumber_.push_back(0);
+        tree_.numberCount_.push_back(0);
+        tree_.firstChild_.push_back(FlatTree::npos);
+        tree_.nextSibling_.push_back(FlatTree::npos);
+        tree_.ranges_.push_back({toOffset(name.position), 0});
+        
+        if (!stack_.empty()) 
+        {
+            Frame& parent = stack_.back();
+            if (parent.lastChild == FlatTree::npos) 
+            {
+                tree_.firstChild_[parent.index] = index;
+            }
+            else 
+            {
+                tree_.nextSibling_[parent.lastChild] = index;
+            }
+            parent.lastChild = index;
+        }
+        
+        stack_.push_back({index, FlatTree::npos, pending_.size()});
+    }
+    
+    void stringValue(const Token& token) 
+    {
+        // the string body starts right after the opening quote
+        tree_.values_[stack_.back().index] = {toOffset(token.position + 1), toOffset(token.value.size())};
+    }
+    
+    void number(const Token&, double value) 
+    {
+        // numbers may be interleaved with children; keep them aside until the
+        // node closes so each node's numbers end up contiguous
+        pending_.push_back(value);
+    }
+    
+    void close(size_t end) 
+    {
+        const Frame frame = stack_.back();
+        stack_.pop_back();
+        
+        tree_.firstNumber_[frame.index] = static_cast<uint32_t>(tree_.numbers_.size());
+        tree_.numberCount_[frame.index] = static_cast<uint32_t>(pending_.size() - frame.pendingBase);
+        tree_.numbers_.insert(tree_.numbers_.end(), pending_.begin() + frame.pendingBase, pending_.end());
+        pending_.resize(frame.pendingBase);
+        
+        FlatTree::Span& range = tree_.ranges_[frame.index];
+        range.length = toOffset(end) - range.offset;
+    }
+    
+private:
+    struct Frame 
+    {
+        uint32_t index;
+        uint32_t lastChild;
+        size_t pendingBase;
+    };
+    
+    static uint32_t toOffset(size_t value) 
+    {
+        if (value >= FlatTree::npos) 
+        {
+            throw std::length_error("FlatTree: input exceeds 4 GiB");
+        }
+        return static_cast<uint32_t>(value);
+    }
     
-    parseNodeContent(*node);
+    FlatTree& tree_;
+    std::vector<Frame> stack_;
+    std::vector<double> pending_;
+};
+
+} // namespace detail
+
+// ============================================================================
+// Parser - grammar
+// ============================================================================
+
+NodePtr Parser::parse(SectionIndex* index) 
+{
+    detail::PhaseScope phase(instrument::Phase::Parse, 0);
+    const size_t start = peek().position;
     
-    Token closeToken = consume(TokenType::RBracket, "Expected ']' to close section");
+    detail::TreeBuilder builder(resource_, 0, index, scratch_ ? scratch_ : resource_);
+    parseDocument(builder);
+    phase.addBytes(previous().position + previous().value.size() - start);   // through the last token
+    return builder.take();
+}
+
+void Parser::parseFlat(FlatTree& out) 
+{
+    detail::FlatTreeBuilder builder(out);
+    parseDocument(builder);
+}
+
+NodePtr Parser::parseNext(std::pmr::memory_resource* resource, std::pair<size_t, size_t>& range,
+                          SectionIndex* index) 
+{
+    throwLookaheadError();
+    const size_t start = peek().position;
+    detail::TreeBuilder builder(resource, start, index, scratch_ ? scratch_ : resource);
+    parseNode(builder);
     
-    node->setSourceRange(startPos, closeToken.position + 1);
+    NodePtr root = builder.take();
+    range = {start, start + root->sourceEnd()};
+    return root;
+}
+
+std::pair<size_t, size_t> Parser::skipNext() 
+{
+    throwLookaheadError();
+    const size_t start = peek().position;
+    SkipBuilder builder;
+    parseNode(builder);
+    return {start, builder.end()};
+}
+
+void Parser::validate() 
+{
+    SkipBuilder builder;
+    parseDocument(builder);
+}
+
+template<typename Builder>
+void Parser::parseDocument(Builder& builder) 
+{
+    if (isAtEnd()) 
+    {
+        error("Empty input");
+    }
+    
+    parseNode(builder);
+    throwLookaheadError();
     
-    return node;
+    if (!isAtEnd()) {
+        error("Unexpected token after end of WKT: " + std::string(peek().value));
+    }
 }
 
-void Parser::parseNodeContent(WKTNode& node) {
-    // content can be:
+template<typename Builder>
+void Parser::openNode(Builder& builder)
+{
+    // expect: IDENTIFIER '['
+    builder.open(consume(TokenType::Identifier, "Expected section name"));
+    
+    consume(TokenType::LBracket, "Expected '[' after section name");
+}
+
+template<typename Builder>
+void Parser::parseNode(Builder& builder)
+{
+    // IDENTIFIER '[' content ']', where content can be:
     // - Empty: []
     // - String only: ["name"]
     // - String + numbers: ["name", 123, 456]
     // - String + numbers + children: ["name", 123, CHILD[...]]
     // - Numbers only (rare): [123, 456]
     // - Children only: [CHILD1[...], CHILD2[...]]
-    
-    if (check(TokenType::RBracket)) {
-        // Empty content
-        return;
-    }
-    
+    //
+    // Iterative: the builder keeps the open nodes, so nesting depth costs
+    // heap rather than call stack. Only the depth is tracked here.
+    openNode(builder);
+    size_t depth = 1;
     bool expectComma = false;
     
-    while (!check(TokenType::RBracket) && !isAtEnd())
+    for (;;)
     {
-        if (expectComma) 
+        if (expectComma && check(TokenType::Comma)) 
         {
-            if (check(TokenType::Comma)) 
-            {
-                advance();
-            }
-            if (check(TokenType::RBracket)) 
+            advance();
+        }
+        
+        if (check(TokenType::RBracket) || isAtEnd()) 
+        {
+            if (depth == 1 && check(TokenType::RBracket)) 
             {
-                break;
+                builder.close(closeTopLevel().position + 1);
+                return;
             }
+            builder.close(consume(TokenType::RBracket, "Expected ']' to close section").position + 1);
+            --depth;
+            expectComma = true;   // the closed child was a value of its parent
         }
-        
-        if (check(TokenType::String)) 
+        else if (check(TokenType::String)) 
         {
             // String value (usually first)
-            Token strToken = advance();
-            node.setStringValue(strToken.value);
+            builder.stringValue(advance());
             expectComma = true;
         }
         else if (check(TokenType::Number))
         {
-            // Numeric value
-            Token numToken = advance();
-            
-            try 
-            {
-                double value = std::stod(numToken.value);
-                node.addNumber(value);
-            } 
-            catch (const std::exception&) 
-            {
-                error("Invalid number: " + numToken.value);
-            }
+            // Numeric value, already converted by the lexer
+            const Token& numToken = advance();
+            builder.number(numToken, numToken.number);
             
             expectComma = true;
         }
         else if (check(TokenType::Identifier)) 
         {
-            // Nested node
-            auto child = parseNode();
-            node.addChild(std::move(child));
-            expectComma = true;
+            // Nested node: its content comes next
+            openNode(builder);
+            ++depth;
+            expectComma = false;
         }
         else if (check(TokenType::Comma)) 
         {
@@ -132,22 +390,47 @@ void Parser::parseNodeContent(WKTNode& node) {
 
 const Token& Parser::peek() const 
 {
-    return tokens_[current_];
+    return current_;
 }
 
 const Token& Parser::previous() const 
 {
-    return tokens_[current_ - 1];
+    return previous_;
 }
 
-Token Parser::advance() 
+const Token& Parser::advance() 
 {
     if (!isAtEnd()) {
-        current_++;
+        previous_ = current_;
+        current_ = pull();
     }
     return previous();
 }
 
+Token Parser::pull()
+{
+    if (lexer_) 
+    {
+        return lexer_->nextToken();
+    }
+    
+    if (next_ < tokens_.size()) 
+    {
+        return tokens_[next_++];
+    }
+    
+    // exhausted (or empty) token vector behaves like end of input
+    Token end{};
+    end.type = TokenType::EndOfInput;
+    if (!tokens_.empty()) 
+    {
+        end.position = tokens_.back().position;
+        end.line = tokens_.back().line;
+        end.column = tokens_.back().column;
+    }
+    return end;
+}
+
 bool Parser::check(TokenType type) const 
 {
     if (isAtEnd()) return false;
@@ -163,13 +446,43 @@ bool Parser::match(TokenType type)
     return false;
 }
 
-Token Parser::consume(TokenType type, const std::string& message) 
+const Token& Parser::consume(TokenType type, const char* message) 
 {
     if (check(type))
     {
         return advance();
     }
-    error(message + " (got " + peek().typeName() + ": '" + peek().value + "')");
+    error(std::string(message) + " (got " + peek().typeName() + ": '" + std::string(peek().value) + "')");
+}
+
+const Token& Parser::closeTopLevel() 
+{
+    // The token after a top-level ']' is not part of the node. If it cannot
+    // be lexed, the node still stands; the error is held as the lookahead
+    // (an end-of-input token placed right after the ']') until it is needed.
+    previous_ = current_;
+    try 
+    {
+        current_ = pull();
+    }
+    catch (const LexerError&) 
+    {
+        lookaheadError_ = std::current_exception();
+        current_ = previous_;
+        current_.type = TokenType::EndOfInput;
+        current_.value = {};
+        current_.position += 1;
+        current_.column += 1;
+    }
+    return previous();
+}
+
+void Parser::throwLookaheadError() 
+{
+    if (lookaheadError_) 
+    {
+        std::rethrow_exception(std::exchange(lookaheadError_, nullptr));
+    }
 }
 
 bool Parser::isAtEnd() const 
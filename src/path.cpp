@@ -0,0 +1,128 @@
+#include "wkt_parser.hpp"
+#include <type_traits>
+
+namespace wkt
+{
+
+// ============================================================================
+// CompiledPath
+// ============================================================================
+
+CompiledPath::CompiledPath(std::string_view path, NameMatch match, Search search)
+    : path_(path)
+    , match_(match)
+    , search_(search)
+{
+    compile();
+}
+
+CompiledPath::CompiledPath(const CompiledPath& other)
+    : path_(other.path_)
+    , match_(other.match_)
+    , search_(other.search_)
+{
+    compile();
+}
+
+CompiledPath& CompiledPath::operator=(const CompiledPath& other)
+{
+    if (this != &other)
+    {
+        path_ = other.path_;
+        match_ = other.match_;
+        search_ = other.search_;
+        compile();
+    }
+    return *this;
+}
+
+void CompiledPath::compile()
+{
+    // the same grammar as findByPath
+    names_.clear();
+    matchesNothing_ = !names::resolvePath(path_, names_);
+}
+
+namespace
+{
+
+// Anchored walk: each name is a direct child of the previous match
+template<typename Node>
+Node followChildren(Node node, const SectionName* names, size_t count, NameMatch match)
+{
+    for (size_t i = 0; i < count && node; ++i)
+    {
+        if constexpr (std::is_pointer_v<Node>)
+        {
+            node = node->findChild(names[i], match);
+        }
+        else
+        {
+            node = node.findChild(names[i], match);
+        }
+    }
+    return node;
+}
+
+} // namespace
+
+WKTNode* CompiledPath::findFrom(WKTNode* node) const
+{
+    if (!node || matchesNothing_)
+    {
+        return nullptr;
+    }
+
+    if (search_ == Search::Deep)
+    {
+        return node->findByNames(names_.data(), names_.size(), match_);
+    }
+    return followChildren(node, names_.data(), names_.size(), match_);
+}
+
+const WKTNode* CompiledPath::findFrom(const WKTNode* node) const
+{
+    return findFrom(const_cast<WKTNode*>(node));
+}
+
+WKTNode* CompiledPath::find(WKTDocument& doc) const
+{
+    WKTNode* root = doc.root();
+    if (!root || matchesNothing_)
+    {
+        return nullptr;
+    }
+
+    // the path may start at the root itself
+    const size_t first = (!names_.empty() && names::matches(root->sectionName(), names_[0], match_)) ? 1 : 0;
+
+    if (search_ == Search::Deep)
+    {
+        return root->findByNames(names_.data() + first, names_.size() - first, match_);
+    }
+    return followChildren(root, names_.data() + first, names_.size() - first, match_);
+}
+
+const WKTNode* CompiledPath::find(const WKTDocument& doc) const
+{
+    return find(const_cast<WKTDocument&>(doc));
+}
+
+FlatNode CompiledPath::find(const FlatTree& tree) const
+{
+    if (tree.empty() || matchesNothing_)
+    {
+        return FlatNode();
+    }
+
+    const FlatNode root = tree.root();
+    const size_t first = (!names_.empty() && names::matches(root.sectionName(), names_[0], match_)) ? 1 : 0;
+
+    if (search_ == Search::Deep)
+    {
+        return root.findByNames(names_.data() + first, names_.size() - first, match_);
+    }
+    return followChildren(root, names_.data() + first, names_.size() - first, match_);
+}
+
+} // namespace wkt
@@ -0,0 +1,239 @@
+#include "wkt_parser.hpp"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define WKT_SCAN_SSE2 1
+    #include <emmintrin.h>
+#endif
+
+#if WKT_SCAN_SSE2 && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define WKT_SCAN_AVX2 1
+    #include <immintrin.h>
+#endif
+
+namespace wkt
+{
+
+namespace detail
+{
+
+// ============================================================================
+// Scalar classifier
+// ============================================================================
+
+BlockMasks classifyBlockScalar(const char* data, size_t size)
+{
+    BlockMasks masks{};
+    for (size_t i = 0; i < size; ++i)
+    {
+        const unsigned char c = static_cast<unsigned char>(data[i]);
+        const uint64_t bit = uint64_t(1) << i;
+
+        switch (c)
+        {
+            case '\n': masks.newline |= bit; [[fallthrough]];
+            case ' ':
+            case '\t':
+            case '\r': masks.whitespace |= bit; break;
+            case '"':  masks.quote |= bit; break;
+            case '\\': masks.escape |= bit; break;
+            case '[':
+            case ']':  masks.bracket |= bit; break;
+            default:
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_')
+                {
+                    masks.word |= bit;
+                }
+                break;
+        }
+    }
+    return masks;
+}
+
+// ============================================================================
+// SSE2 classifier - four 16-byte lanes per block
+// ============================================================================
+
+#if WKT_SCAN_SSE2
+
+namespace
+{
+
+// Bytes within [lo, lo + count) as a signed compare on biased values
+inline __m128i inRange16(__m128i v, char lo, char count)
+{
+    const __m128i shifted = _mm_xor_si128(_mm_sub_epi8(v, _mm_set1_epi8(lo)), _mm_set1_epi8(char(0x80)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(char(0x80 + count)));
+}
+
+inline uint64_t maskBits16(__m128i m, unsigned shift)
+{
+    return uint64_t(uint32_t(_mm_movemask_epi8(m))) << shift;
+}
+
+inline void classify16(const char* p, unsigned shift, BlockMasks& masks)
+{
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+
+    const __m128i newline = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    const __m128i space = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), newline));
+    const __m128i quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+    const __m128i escape = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+    const __m128i bracket = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('[')), _mm_cmpeq_epi8(v, _mm_set1_epi8(']')));
+
+    const __m128i letter = inRange16(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 26);
+    const __m128i digit = inRange16(v, '0', 10);
+    const __m128i word = _mm_or_si128(_mm_or_si128(letter, digit), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+
+    masks.whitespace |= maskBits16(space, shift);
+    masks.newline |= maskBits16(newline, shift);
+    masks.quote |= maskBits16(quote, shift);
+    masks.escape |= maskBits16(escape, shift);
+    masks.word |= maskBits16(word, shift);
+    masks.bracket |= maskBits16(bracket, shift);
+}
+
+[[maybe_unused]] BlockMasks classifyBlockSSE2(const char* data)
+{
+    BlockMasks masks{};
+    classify16(data, 0, masks);
+    classify16(data + 16, 16, masks);
+    classify16(data + 32, 32, masks);
+    classify16(data + 48, 48, masks);
+    return masks;
+}
+
+} // namespace
+
+#endif
+
+// ============================================================================
+// AVX2 classifier - two 32-byte lanes per block, selected at runtime
+// ============================================================================
+
+#if WKT_SCAN_AVX2
+
+namespace
+{
+
+__attribute__((target("avx2")))
+inline __m256i inRange32(__m256i v, char lo, char count)
+{
+    const __m256i shifted = _mm256_xor_si256(_mm256_sub_epi8(v, _mm256_set1_epi8(lo)), _mm256_set1_epi8(char(0x80)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(char(0x80 + count)), shifted);
+}
+
+__attribute__((target("avx2")))
+inline uint64_t maskBits32(__m256i m, unsigned shift)
+{
+    return uint64_t(uint32_t(_mm256_movemask_epi8(m))) << shift;
+}
+
+__attribute__((target("avx2")))
+inline void classify32(const char* p, unsigned shift, BlockMasks& masks)
+{
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+
+    const __m256i newline = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    const __m256i space = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), newline));
+    const __m256i quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+    const __m256i escape = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+    const __m256i bracket = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(']')));
+
+    const __m256i letter = inRange32(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 26);
+    const __m256i digit = inRange32(v, '0', 10);
+    const __m256i word = _mm256_or_si256(_mm256_or_si256(letter, digit), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+
+    masks.whitespace |= maskBits32(space, shift);
+    masks.newline |= maskBits32(newline, shift);
+    masks.quote |= maskBits32(quote, shift);
+    masks.escape |= maskBits32(escape, shift);
+    masks.word |= maskBits32(word, shift);
+    masks.bracket |= maskBits32(bracket, shift);
+}
+
+__attribute__((target("avx2")))
+[[maybe_unused]] BlockMasks classifyBlockAVX2(const char* data)
+{
+    BlockMasks masks{};
+    classify32(data, 0, masks);
+    classify32(data + 32, 32, masks);
+    return masks;
+}
+
+} // namespace
+
+#endif
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+namespace
+{
+
+using FullBlockClassifier = BlockMasks (*)(const char*);
+
+[[maybe_unused]] BlockMasks classifyFullBlockScalar(const char* data)
+{
+    return classifyBlockScalar(data, 64);
+}
+
+struct Classifier
+{
+    FullBlockClassifier classify;
+    const char* name;
+};
+
+Classifier selectClassifier()
+{
+#if defined(WKT_NO_SIMD)
+    return {classifyFullBlockScalar, "scalar"};
+#else
+  #if WKT_SCAN_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return {classifyBlockAVX2, "avx2"};
+    }
+  #endif
+  #if WKT_SCAN_SSE2
+    return {classifyBlockSSE2, "sse2"};
+  #else
+    return {classifyFullBlockScalar, "scalar"};
+  #endif
+#endif
+}
+
+const Classifier& classifier()
+{
+    static const Classifier selected = selectClassifier();
+    return selected;
+}
+
+} // namespace
+
+BlockMasks classifyBlock(const char* data, size_t size)
+{
+    if (size >= 64)
+    {
+        return classifier().classify(data);
+    }
+
+    // pad the tail; NUL bytes fall in no class, so the padding stays clear
+    char padded[64] = {};
+    std::memcpy(padded, data, size);
+    return classifier().classify(padded);
+}
+
+const char* simdLevel()
+{
+    return classifier().name;
+}
+
+} // namespace detail
+
+} // namespace wkt
@@ -0,0 +1,579 @@
+#include "wkt_parser.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <charconv>
+#include <cstring>
+#include <system_error>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define WKT_HAVE_WRITEV 1
+    #include <climits>
+    #include <sys/uio.h>
+    #include <unistd.h>
+#elif defined(_WIN32)
+    #include <io.h>
+#endif
+
+namespace wkt
+{
+
+// ============================================================================
+// Sinks
+// ============================================================================
+
+void FileSink::write(const char* data, size_t size)
+{
+    if (std::fwrite(data, 1, size, file_) != size)
+    {
+        throw std::system_error(errno ? errno : EIO, std::generic_category(), "Cannot write serialized WKT");
+    }
+}
+
+void FdSink::write(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+#if defined(_WIN32)
+        const int written = ::_write(fd_, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+#else
+        const ssize_t written = ::write(fd_, data, size);
+#endif
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "Cannot write serialized WKT");
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+// ============================================================================
+// Serializer
+// ============================================================================
+
+namespace
+{
+
+constexpr size_t kNumberBufferSize = 32;
+
+// Shortest text that parses back to exactly `value`. Integral values below
+// 1e15 are written out in full (500000, not 5e+05) even when an exponent
+// would be shorter; their digits are exact, so they still round-trip.
+// Negative zero is written as 0, as it always has been.
+size_t formatNumber(double value, char* out)
+{
+    constexpr double kFixedLimit = 1e15;
+    const bool integral = std::fabs(value) < kFixedLimit && value == std::trunc(value);
+    if (value == 0.0)
+    {
+        value = 0.0;
+    }
+    const auto result = integral ? std::to_chars(out, out + kNumberBufferSize, value, std::chars_format::fixed)
+                                 : std::to_chars(out, out + kNumberBufferSize, value);
+    return static_cast<size_t>(result.ptr - out);
+}
+
+// The three writers share one emit(): the counter yields the exact size,
+// the string writer appends to a string, the sink writer batches output
+// for an OutputSink.
+class SizeCounter
+{
+public:
+    void put(char) { ++size_; }
+    void put(const char*, size_t size) { size_ += size; }
+    void spaces(size_t count) { size_ += count; }
+
+    size_t size() const { return size_; }
+
+private:
+    size_t size_ = 0;
+};
+
+class StringWriter
+{
+public:
+    explicit StringWriter(std::string& out) : out_(out) {}
+
+    void put(char c) { out_.push_back(c); }
+    void put(const char* data, size_t size) { out_.append(data, size); }
+    void spaces(size_t count) { out_.append(count, ' '); }
+
+private:
+    std::string& out_;
+};
+
+class SinkWriter
+{
+public:
+    explicit SinkWriter(OutputSink& sink) : sink_(sink) {}
+
+    void put(char c)
+    {
+        if (used_ == sizeof(buffer_))
+        {
+            flush();
+        }
+        buffer_[used_++] = c;
+    }
+
+    void put(const char* data, size_t size)
+    {
+        if (size > sizeof(buffer_) - used_)
+        {
+            flush();
+            if (size > sizeof(buffer_))
+            {
+                sink_.write(data, size);
+                written_ += size;
+                return;
+            }
+        }
+        std::memcpy(buffer_ + used_, data, size);
+        used_ += size;
+    }
+
+    void spaces(size_t count)
+    {
+        while (count > 0)
+        {
+            if (used_ == sizeof(buffer_))
+            {
+                flush();
+            }
+            const size_t run = std::min(count, sizeof(buffer_) - used_);
+            std::memset(buffer_ + used_, ' ', run);
+            used_ += run;
+            count -= run;
+        }
+    }
+
+    void flush()
+    {
+        if (used_ > 0)
+        {
+            sink_.write(buffer_, used_);
+            written_ += used_;
+            used_ = 0;
+        }
+    }
+
+    size_t written() const { return written_; }
+
+private:
+    OutputSink& sink_;
+    char buffer_[4096];
+    size_t used_ = 0;
+    size_t written_ = 0;
+};
+
+struct Layout
+{
+    explicit Layout(const SerializeOptions& options)
+        : pretty(options.indent >= 0)
+        , step(pretty ? static_cast<size_t>(options.indent) : 0)
+        , source(options.numbers == NumberFormat::Original ? options.source : std::string_view{})
+    {}
+
+    bool pretty;
+    size_t step;
+    std::string_view source;   // empty unless original lexemes are copied
+};
+
+// Builds a patch list. Pieces are kept as offsets while the generated
+// buffer can still grow, and only turned into views at the end.
+class PatchWriter
+{
+public:
+    PatchWriter(std::string_view source, std::vector<char>& generated)
+        : source_(source)
+        , generated_(generated)
+    {}
+
+    // Generated text, through the same interface as the other writers
+    void put(char c)
+    {
+        generated_.push_back(c);
+        extend(true, generated_.size() - 1, 1);
+    }
+
+    void put(const char* data, size_t size)
+    {
+        generated_.insert(generated_.end(), data, data + size);
+        extend(true, generated_.size() - size, size);
+    }
+
+    void spaces(size_t count)
+    {
+        generated_.resize(generated_.size() + count, ' ');
+        extend(true, generated_.size() - count, count);
+    }
+
+    // Source text [start, end)
+    void copy(size_t start, size_t end)
+    {
+        extend(false, start, end - start);
+    }
+
+    // True if a node's range [start, end) lies inside the source it is
+    // patched against
+    bool covers(size_t start, size_t end) const
+    {
+        return start <= end && end <= source_.size();
+    }
+
+    size_t finish(std::vector<std::string_view>& pieces) const
+    {
+        size_t size = 0;
+        pieces.clear();
+        pieces.reserve(pieces_.size());
+        for (const Piece& piece : pieces_)
+        {
+            const char* base = piece.generated ? generated_.data() : source_.data();
+            pieces.emplace_back(base + piece.offset, piece.length);
+            size += piece.length;
+        }
+        return size;
+    }
+
+private:
+    struct Piece
+    {
+        bool generated;
+        size_t offset;
+        size_t length;
+    };
+
+    // appends to the last piece when the new bytes directly follow it
+    void extend(bool generated, size_t offset, size_t length)
+    {
+        if (length == 0)
+        {
+            return;
+        }
+        if (!pieces_.empty())
+        {
+            Piece& last = pieces_.back();
+            if (last.generated == generated && last.offset + last.length == offset)
+            {
+                last.length += length;
+                return;
+            }
+        }
+        pieces_.push_back({generated, offset, length});
+    }
+
+    std::string_view source_;
+    std::vector<char>& generated_;
+    std::vector<Piece> pieces_;
+};
+
+// A node being written: its head is out, its children are next. The
+// walk keeps these on an explicit stack, so nesting depth costs heap rather
+// than call stack; the stack index is the node's depth.
+struct Frame
+{
+    const WKTNode* node;
+    size_t start;       // node.sourceStart(), tracked down the walk in O(1)
+    size_t next;        // child to write next
+    bool needComma;     // something precedes the next child
+    bool keepSource;    // patch writer: the node's own text is copied around its children
+    size_t copied;      // ... up to here
+};
+
+using Stack = std::vector<Frame>;
+
+// Writes the node's name, value and numbers, leaving it open on the stack
+template<typename Out>
+void open(const WKTNode& node, size_t start, Out& out, const Layout& layout, Stack& stack)
+{
+    const std::string_view name = node.name();
+    out.put(name.data(), name.size());
+    out.put('[');
+
+    bool needComma = false;
+    if (const auto& value = node.stringValue())
+    {
+        out.put('"');
+        out.put(value->data(), value->size());
+        out.put('"');
+        needComma = true;
+    }
+
+    char number[kNumberBufferSize];
+    const std::pmr::vector<double>& numbers = node.numbers();
+    for (size_t i = 0; i < numbers.size(); ++i)
+    {
+        if (needComma)
+        {
+            out.put(',');
+        }
+        needComma = true;
+
+        if (!layout.source.empty())
+        {
+            const WKTNode::Lexeme lexeme = node.numberLexeme(i);
+            if (lexeme.length > 0 && start + lexeme.offset + lexeme.length <= layout.source.size())
+            {
+                out.put(layout.source.data() + start + lexeme.offset, lexeme.length);
+                continue;
+            }
+        }
+        out.put(number, formatNumber(numbers[i], number));
+    }
+
+    stack.push_back({&node, start, 0, needComma, false, 0});
+}
+
+// Children of a re-emitted node: emitted in full, except by the patch
+// writer, which keeps whatever source text it can
+template<typename Out>
+void openChild(const WKTNode& child, size_t start, Out& out, const Layout& layout, Stack& stack)
+{
+    open(child, start, out, layout, stack);
+}
+
+void openChild(const WKTNode& node, size_t start, PatchWriter& out, const Layout& layout, Stack& stack)
+{
+    const size_t end = start + node.sourceLength();
+    if (out.covers(start, end))
+    {
+        if (node.isClean())
+        {
+            out.copy(start, end);
+            return;
+        }
+
+        if (!node.isModified())
+        {
+            // only descendants changed, so the children are the parsed ones:
+            // keep the node's own text around them
+            stack.push_back({&node, start, 0, false, true, start});
+            return;
+        }
+    }
+    open(node, start, out, layout, stack);
+}
+
+// Writes `root`, whose sourceStart() is `start`, and everything below it
+template<typename Out>
+void emit(const WKTNode& root, size_t start, Out& out, const Layout& layout)
+{
+    constexpr bool kPatch = std::is_same_v<Out, PatchWriter>;
+    const bool pretty = layout.pretty;
+    const size_t step = layout.step;
+
+    Stack stack;
+    openChild(root, start, out, layout, stack);
+    while (!stack.empty())
+    {
+        Frame& frame = stack.back();
+        const size_t depth = stack.size() - 1;
+        const auto& children = frame.node->children();
+
+        if (frame.next == children.size())
+        {
+            if constexpr (kPatch)
+            {
+                if (frame.keepSource)
+                {
+                    out.copy(frame.copied, frame.start + frame.node->sourceLength());
+                    stack.pop_back();
+                    continue;
+                }
+            }
+            if (pretty && !children.empty())
+            {
+                out.put('\n');
+                out.spaces(depth * step);
+            }
+            out.put(']');
+            stack.pop_back();
+            continue;
+        }
+
+        const WKTNode& child = *children[frame.next++];
+        const size_t childStart = frame.start + child.sourceOffset();
+        if constexpr (kPatch)
+        {
+            if (frame.keepSource)
+            {
+                out.copy(frame.copied, childStart);
+                frame.copied = childStart + child.sourceLength();
+                openChild(child, childStart, out, layout, stack);
+                continue;
+            }
+        }
+
+        if (frame.needComma)
+        {
+            out.put(',');
+        }
+        if (pretty)
+        {
+            out.put('\n');
+            out.spaces((depth + 1) * step);
+        }
+        frame.needComma = true;
+        openChild(child, childStart, out, layout, stack);
+    }
+}
+
+} // namespace
+
+void WKTNode::serialize(OutputSink& sink, const SerializeOptions& options) const
+{
+    detail::PhaseScope phase(instrument::Phase::Serialize, 0);
+    SinkWriter writer(sink);
+    emit(*this, sourceStart(), writer, Layout(options));
+    writer.flush();
+    phase.addBytes(writer.written());
+}
+
+size_t WKTNode::serializedSize(const SerializeOptions& options) const
+{
+    SizeCounter counter;
+    emit(*this, sourceStart(), counter, Layout(options));
+    return counter.size();
+}
+
+std::string WKTNode::toString(const SerializeOptions& options) const
+{
+    detail::PhaseScope phase(instrument::Phase::Serialize, 0);
+    const Layout layout(options);
+    const size_t start = sourceStart();
+
+    std::string result;
+    if (options.exactSize)
+    {
+        SizeCounter counter;
+        emit(*this, start, counter, layout);
+        result.reserve(counter.size());
+    }
+    else
+    {
+        // the source span is close for a compact parsed tree; grow from there
+        result.reserve(sourceLength());
+    }
+    StringWriter writer(result);
+    emit(*this, start, writer, layout);
+    phase.addBytes(result.size());
+    return result;
+}
+
+std::string WKTNode::toString(int indent) const
+{
+    SerializeOptions options;
+    options.indent = indent;
+    return toString(options);
+}
+
+// ============================================================================
+// Patch serialization
+// ============================================================================
+
+PatchList WKTDocument::patch() const
+{
+    PatchList result;
+    if (!root_)
+    {
+        return result;
+    }
+
+    SerializeOptions options;
+    options.numbers = NumberFormat::Original;
+    options.source = originalSource();
+
+    // text around the root (e.g. a trailing newline) is kept as well, so
+    // an unedited document patches to exactly its source
+    PatchWriter writer(options.source, result.generated_);
+    const size_t start = root_->sourceStart();
+    const size_t end = start + root_->sourceLength();
+    const bool covered = writer.covers(start, end);
+    if (covered)
+    {
+        writer.copy(0, start);
+    }
+    emit(*root_, start, writer, Layout(options));
+    if (covered)
+    {
+        writer.copy(end, options.source.size());
+    }
+    result.size_ = writer.finish(result.pieces_);
+    return result;
+}
+
+void PatchList::writeTo(OutputSink& sink) const
+{
+    for (std::string_view piece : pieces_)
+    {
+        sink.write(piece.data(), piece.size());
+    }
+}
+
+void PatchList::writeTo(int fd) const
+{
+#if WKT_HAVE_WRITEV
+    std::vector<iovec> vectors;
+    vectors.reserve(std::min<size_t>(pieces_.size(), IOV_MAX));
+
+    size_t next = 0;
+    while (next < pieces_.size())
+    {
+        vectors.clear();
+        for (size_t i = next; i < pieces_.size() && vectors.size() < IOV_MAX; ++i)
+        {
+            vectors.push_back({const_cast<char*>(pieces_[i].data()), pieces_[i].size()});
+        }
+
+        size_t first = 0;
+        while (first < vectors.size())
+        {
+            const ssize_t written = ::writev(fd, &vectors[first], static_cast<int>(vectors.size() - first));
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Cannot write serialized WKT");
+            }
+
+            // skip what went out; a partial write resumes inside a piece
+            size_t done = static_cast<size_t>(written);
+            while (first < vectors.size() && done >= vectors[first].iov_len)
+            {
+                done -= vectors[first].iov_len;
+                ++first;
+            }
+            if (first < vectors.size())
+            {
+                vectors[first].iov_base = static_cast<char*>(vectors[first].iov_base) + done;
+                vectors[first].iov_len -= done;
+            }
+        }
+        next += vectors.size();
+    }
+#else
+    FdSink sink(fd);
+    writeTo(sink);
+#endif
+}
+
+std::string PatchList::toString() const
+{
+    std::string result;
+    result.reserve(size_);
+    for (std::string_view piece : pieces_)
+    {
+        result.append(piece);
+    }
+    return result;
+}
+
+} // namespace wkt
@@ -0,0 +1,246 @@
+#include "wkt_parser.hpp"
+#include <algorithm>
+
+namespace wkt
+{
+
+// ============================================================================
+// WKTStreamReader
+// ============================================================================
+
+struct WKTStreamReader::State
+{
+    State(std::string_view text, size_t baseOffset, std::pmr::memory_resource* resource,
+          std::pmr::memory_resource* scratchResource = nullptr)
+        : input(text)
+        , base(baseOffset)
+        , upstream(resource)
+        , scratch(scratchResource)
+        , lexer(text)
+    {}
+
+    // openFile only: the bytes behind input
+    std::unique_ptr<detail::MappedFile> mapping;
+    std::pmr::string buffer;
+
+    std::string_view input;
+    size_t base;
+    std::pmr::memory_resource* upstream;
+    std::pmr::memory_resource* scratch;   // transient parser state, or nullptr
+
+    Lexer lexer;
+    std::optional<Parser> parser;   // dropped after an error, rebuilt on the next line
+};
+
+namespace
+{
+
+inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline bool startsName(char c)
+{
+    const char lower = static_cast<char>(c | 0x20);
+    return (lower >= 'a' && lower <= 'z') || c == '_';
+}
+
+size_t skipBlanks(std::string_view input, size_t pos)
+{
+    while (pos < input.size() && isBlank(input[pos]))
+    {
+        ++pos;
+    }
+    return pos;
+}
+
+// First record start after a line break in [from, limit): a section name
+// that opens a line (after optional blanks) whose previous line ended with
+// ']', outside any quoted string. Quotes are tracked from `scanFrom`, which
+// must itself be outside a string (a record start), with the lexer's
+// backslash escapes. Returns input.size() if there is none.
+size_t nextBoundary(std::string_view input, size_t scanFrom, size_t from, size_t limit)
+{
+    bool inString = false;
+    size_t pos = scanFrom;
+    for (;;)
+    {
+        pos = input.find_first_of(inString ? "\"\\" : "\"\n", pos);
+        if (pos == std::string_view::npos || pos >= limit)
+        {
+            return input.size();
+        }
+
+        const char c = input[pos];
+        if (c == '"')
+        {
+            inString = !inString;
+            ++pos;
+            continue;
+        }
+        if (c == '\\')
+        {
+            pos += 2;
+            continue;
+        }
+
+        const size_t newline = pos;
+        const size_t ahead = skipBlanks(input, newline + 1);
+        if (newline >= from)
+        {
+            size_t back = newline;
+            while (back > 0 && input[back - 1] != '\n' && isBlank(input[back - 1]))
+            {
+                --back;
+            }
+            if (back > 0 && input[back - 1] == ']' && ahead < input.size() && startsName(input[ahead]))
+            {
+                return ahead;
+            }
+        }
+
+        // newlines inside the blank run cannot follow a ']' either
+        pos = std::max(newline + 1, ahead);
+    }
+}
+
+} // namespace
+
+WKTStreamReader::WKTStreamReader(std::string_view input, std::pmr::memory_resource* upstream)
+    : state_(std::make_unique<State>(input, 0, upstream))
+{}
+
+WKTStreamReader::WKTStreamReader(const StreamChunk& chunk, std::pmr::memory_resource* upstream,
+                                 std::pmr::memory_resource* scratch)
+    : state_(std::make_unique<State>(chunk.text, chunk.offset, upstream, scratch))
+{}
+
+WKTStreamReader WKTStreamReader::openFile(const std::string& path, std::pmr::memory_resource* upstream)
+{
+    WKTStreamReader reader(std::string_view{}, upstream);
+    State& state = *reader.state_;
+
+    state.mapping = detail::loadFile(path, state.buffer);
+    state.input = state.mapping ? state.mapping->view() : std::string_view(state.buffer);
+    state.lexer = Lexer(state.input);
+    return reader;
+}
+
+WKTStreamReader::WKTStreamReader(WKTStreamReader&& other) noexcept = default;
+WKTStreamReader& WKTStreamReader::operator=(WKTStreamReader&& other) noexcept = default;
+WKTStreamReader::~WKTStreamReader() = default;
+
+std::string_view WKTStreamReader::source() const
+{
+    return state_->input;
+}
+
+bool WKTStreamReader::next(StreamRecord& record)
+{
+    return read(record, true);
+}
+
+bool WKTStreamReader::nextSpan(StreamRecord& record)
+{
+    return read(record, false);
+}
+
+bool WKTStreamReader::read(StreamRecord& record, bool buildDocument)
+{
+    State& state = *state_;
+
+    record.document.reset();
+    record.error.clear();
+    record.errorOffset = 0;
+
+    // where the record begins if it fails before its first token is known
+    size_t start = skipBlanks(state.input, state.lexer.position());
+    size_t errorAt = 0;
+
+    try
+    {
+        if (!state.parser)
+        {
+            state.parser.emplace(state.lexer);
+            state.parser->setScratch(state.scratch);
+        }
+
+        Parser& parser = *state.parser;
+        if (!parser.hasNext())
+        {
+            return false;
+        }
+        start = skipBlanks(state.input, parser.nextPosition());   // past a held-back lookahead
+
+        std::pair<size_t, size_t> range;
+        if (buildDocument)
+        {
+            // the tree goes straight into the document's arena, followed by
+            // a copy of just this record as its source
+            WKTDocument doc(detail::makeArena(state.upstream));
+            doc.root_ = parser.parseNext(doc.arena_.get(), range, &doc.index_);
+            doc.source_.assign(state.input.substr(range.first, range.second - range.first));
+            doc.buildParameters();
+            record.document.emplace(std::move(doc));
+        }
+        else
+        {
+            range = parser.skipNext();
+        }
+
+        record.offset = state.base + range.first;
+        record.text = state.input.substr(range.first, range.second - range.first);
+        return true;
+    }
+    catch (const LexerError& e)
+    {
+        record.error = e.what();
+        errorAt = e.position();
+    }
+    catch (const ParseError& e)
+    {
+        record.error = e.what();
+        errorAt = e.token().position;
+    }
+
+    // Resume with a fresh parser on the line after the error, or earlier at
+    // a record boundary the failed record ran across (e.g. a missing ']'
+    // that made it swallow the following lines)
+    size_t resumeFrom = errorAt;
+    const size_t boundary = nextBoundary(state.input, start, start, errorAt);
+    if (boundary < errorAt)
+    {
+        resumeFrom = state.input.rfind('\n', boundary);
+    }
+    state.parser.reset();
+    state.lexer.skipLine(resumeFrom);
+
+    const size_t resume = std::max(start, state.lexer.position());
+    record.offset = state.base + start;
+    record.text = state.input.substr(start, resume - start);
+    record.errorOffset = state.base + errorAt;
+    return true;
+}
+
+std::vector<StreamChunk> WKTStreamReader::split(std::string_view input, size_t count)
+{
+    std::vector<StreamChunk> chunks;
+    count = std::max<size_t>(count, 1);
+
+    // each cut is a record start, so quote parity is tracked from the last one
+    size_t begin = 0;
+    for (size_t i = 1; i <= count && begin < input.size(); ++i)
+    {
+        const size_t target = std::max(begin, input.size() / count * i);
+        const size_t end = (i == count) ? input.size() : nextBoundary(input, begin, target, input.size());
+        if (end > begin)
+        {
+            chunks.push_back({input.substr(begin, end - begin), begin});
+            begin = end;
+        }
+    }
+    return chunks;
+}
+
+} // namespace wkt